@@ -1,91 +1,512 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
 //
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
-// * After changing buffer data, call bwrite to write it to disk.
+// * After changing buffer data, call bwrite to write it to disk,
+//     or bwritev to write several at once.
 // * When done with the buffer, call brelse.
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
-
+//
+// Each hash bucket has its own lock, which protects the bucket's
+// chain and the dev, blockno and refcnt of the buffers on it, so
+// lookups of different blocks rarely contend. The buckets are
+// allocated at boot, about one for every BPERBUCKET buffers the
+// cache may grow to, so chains stay short however big it gets.
+// Recycling a buffer for a new block moves it between buckets;
+// bcache.lock serializes that, so at most one process ever
+// holds two bucket locks at once.
+//
+// Replacement resists scans, in the manner of 2Q. A block read
+// into the cache goes on the cold queue, which is FIFO. If it is
+// used again later, other than in a quick burst of correlated
+// uses, it is marked hot, and the next time the evictor meets it
+// on the cold queue moves it to the hot queue. The hot queue is
+// managed with the CLOCK algorithm. The evictor looks at no more
+// than BSCAN buffers while holding bcache.lock; if they are all
+// in use, bget() lets go, yields, and tries again. Buffers are
+// taken from the cold queue while it holds more than a quarter
+// of the cache, so a long sequential scan recycles only cold
+// buffers, and the hot blocks (inodes, bitmaps, directories)
+// stay cached. Hits touch only flags under the bucket lock; the
+// queues are protected by bcache.lock and change only when a
+// buffer is recycled.
+//
+// Buffers live in pages allocated with kalloc(), BPP to a page.
+// The cache starts with enough pages for NBUF buffers and grows
+// on misses, up to a limit set from the amount of free memory at
+// boot, as long as memory isn't short. When kalloc() runs out of
+// pages it calls bshrink() to free pages whose buffers are all
+// unused.
 
 #include "types.h"
 #include "param.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "riscv.h"
+#include "proc.h"
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "bstat.h"
 
-struct {
+// buffers per hash bucket, once the cache is as big as it gets.
+#define BPERBUCKET 4
+
+// most buffers bvictim() looks at in one go.
+#define BSCAN 64
+
+// most blocks in a bread_range() or breadahead().
+#define MAXRANGE 32
+
+// re-use of a buffer within this many releases of its last
+// release counts as part of the same use.
+#define NCORREL 16
+
+enum { COLD, HOT };
+
+// A replacement queue, linked through qprev/qnext.
+struct bufq {
+  struct buf *head;
+  struct buf *tail;
+  int n;
+};
+
+struct bucket {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct buf *head;  // chain of buffers, through prev/next
+};
+
+// A page of hash buckets.
+#define BKPP (PGSIZE / sizeof(struct bucket))
+#define MAXBKPG 64
+
+// A page of buffers.
+struct bufpage {
+  struct bufpage *next;
+  struct buf buf[(PGSIZE - sizeof(struct bufpage*)) / sizeof(struct buf)];
+};
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+#define BPP (sizeof(((struct bufpage*)0)->buf) / sizeof(struct buf))
+
+struct {
+  struct spinlock lock;  // serializes recycling, growing and shrinking
+  struct bucket *bkpg[MAXBKPG];  // pages of hash buckets
+  int nbucket;
+  uint64 clock;          // source of buf.lastuse stamps
+  struct bufq q[2];      // COLD and HOT replacement queues
+
+  struct bstat stat[NBCLASS];  // by class of block
+
+  struct bufpage *pages; // all pages of buffers
+  int npages;
+  int minpages;          // never shrink below this
+  int maxpages;          // never grow beyond this
+  int reserve;           // don't grow if fewer pages than this are free
 } bcache;
 
+extern struct superblock sb;
+
+// Which part of the file system does blockno belong to?
+static int
+bclass(uint blockno)
+{
+  if(blockno < 2)
+    return BC_SUPER;
+  if(blockno < sb.logstart + sb.nlog)
+    return BC_LOG;
+  if(blockno < sb.bmapstart)
+    return BC_INODE;
+  if(blockno < sb.bmapstart + sb.size/BPB + 1)
+    return BC_BITMAP;
+  return BC_DATA;
+}
+
+#define BCOUNT(blockno, field) \
+  __sync_fetch_and_add(&bcache.stat[bclass(blockno)].field, 1)
+
+static struct bucket*
+bucket(int i)
+{
+  return &bcache.bkpg[i / BKPP][i % BKPP];
+}
+
+static struct bucket*
+bhash(uint dev, uint blockno)
+{
+  return bucket((dev * 7919 + blockno) % bcache.nbucket);
+}
+
+// Is n prime? For sizing the hash table.
+static int
+isprime(int n)
+{
+  for(int d = 2; d * d <= n; d++)
+    if(n % d == 0)
+      return 0;
+  return n > 1;
+}
+
+static void
+bunlink(struct bucket *bk, struct buf *b)
+{
+  if(b->prev)
+    b->prev->next = b->next;
+  else
+    bk->head = b->next;
+  if(b->next)
+    b->next->prev = b->prev;
+}
+
+static void
+blink(struct bucket *bk, struct buf *b)
+{
+  b->prev = 0;
+  b->next = bk->head;
+  if(bk->head)
+    bk->head->prev = b;
+  bk->head = b;
+}
+
+// Put b on replacement queue qn, at the head or the tail.
+// bcache.lock must be held.
+static void
+qinsert(int qn, struct buf *b, int athead)
+{
+  struct bufq *q = &bcache.q[qn];
+
+  b->queue = qn;
+  if(athead){
+    b->qprev = 0;
+    b->qnext = q->head;
+    if(q->head)
+      q->head->qprev = b;
+    else
+      q->tail = b;
+    q->head = b;
+  } else {
+    b->qnext = 0;
+    b->qprev = q->tail;
+    if(q->tail)
+      q->tail->qnext = b;
+    else
+      q->head = b;
+    q->tail = b;
+  }
+  q->n++;
+}
+
+// bcache.lock must be held.
+static void
+qremove(struct buf *b)
+{
+  struct bufq *q = &bcache.q[(int)b->queue];
+
+  if(b->qprev)
+    b->qprev->qnext = b->qnext;
+  else
+    q->head = b->qnext;
+  if(b->qnext)
+    b->qnext->qprev = b->qprev;
+  else
+    q->tail = b->qprev;
+  q->n--;
+}
+
+// Add the buffers on page pg to the cache, holding no block.
+// bcache.lock must be held.
+static void
+baddpage(struct bufpage *pg)
+{
+  struct bucket *bk = bhash(0, 0);
+  struct buf *b;
+
+  pg->next = bcache.pages;
+  bcache.pages = pg;
+  bcache.npages++;
+  acquire(&bk->lock);
+  for(b = pg->buf; b < pg->buf+BPP; b++){
+    memset(b, 0, sizeof(*b));
+    initsleeplock(&b->lock, "buffer");
+    blink(bk, b);
+    qinsert(COLD, b, 1);  // empty: recycle first
+  }
+  release(&bk->lock);
+}
+
 void
 binit(void)
 {
-  struct buf *b;
+  struct bufpage *pg;
+  int i, free = kfreepages();
 
   initlock(&bcache.lock, "bcache");
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+  bcache.minpages = (NBUF + BPP - 1) / BPP;
+  bcache.maxpages = free / 8;
+  bcache.reserve = free / 8;
+  if(bcache.maxpages < bcache.minpages)
+    bcache.maxpages = bcache.minpages;
+
+  // a prime number of buckets, enough for the largest cache.
+  bcache.nbucket = bcache.maxpages * BPP / BPERBUCKET;
+  if(bcache.nbucket < 31)
+    bcache.nbucket = 31;
+  if(bcache.nbucket > MAXBKPG * BKPP)
+    bcache.nbucket = MAXBKPG * BKPP;
+  while(!isprime(bcache.nbucket))
+    bcache.nbucket--;
+  for(i = 0; i < (bcache.nbucket + BKPP - 1) / BKPP; i++)
+    if((bcache.bkpg[i] = (struct bucket *)kalloc()) == 0)
+      panic("binit: buckets");
+  for(i = 0; i < bcache.nbucket; i++){
+    initlock(&bucket(i)->lock, "bcache.bucket");
+    bucket(i)->head = 0;
+  }
+
+  // not holding bcache.lock: kalloc() may call bshrink().
+  for(i = 0; i < bcache.minpages; i++){
+    if((pg = kalloc()) == 0)
+      panic("binit");
+    acquire(&bcache.lock);
+    baddpage(pg);
+    release(&bcache.lock);
   }
 }
 
-// Look through buffer cache for block on device dev.
-// If not found, allocate a buffer.
-// In either case, return locked buffer.
-static struct buf*
-bget(uint dev, uint blockno)
+// Add a page of buffers if the cache may grow.
+static void
+bgrow(void)
 {
+  struct bufpage *pg;
+
+  if(bcache.npages >= bcache.maxpages || kfreepages() <= bcache.reserve)
+    return;
+  if((pg = kalloc()) == 0)
+    return;
+  acquire(&bcache.lock);
+  if(bcache.npages < bcache.maxpages){
+    baddpage(pg);
+    pg = 0;
+  }
+  release(&bcache.lock);
+  if(pg)
+    kfree(pg);
+}
+
+// Try to take the buffers on page pg out of the cache.
+// Fails, leaving them cached, if any of them is in use.
+// bcache.lock must be held.
+static int
+bfreepage(struct bufpage *pg)
+{
+  struct bucket *bk;
   struct buf *b;
+  int i, n;
+
+  for(n = 0; n < BPP; n++){
+    b = &pg->buf[n];
+    bk = bhash(b->dev, b->blockno);
+    acquire(&bk->lock);
+    if(b->refcnt != 0){
+      release(&bk->lock);
+      break;
+    }
+    bunlink(bk, b);
+    release(&bk->lock);
+  }
+  if(n < BPP){
+    // put back the ones already taken out.
+    for(i = 0; i < n; i++){
+      b = &pg->buf[i];
+      bk = bhash(b->dev, b->blockno);
+      acquire(&bk->lock);
+      blink(bk, b);
+      release(&bk->lock);
+    }
+    return 0;
+  }
+  for(b = pg->buf; b < pg->buf+BPP; b++){
+    qremove(b);
+    freelock(&b->lock.lk);
+  }
+  return 1;
+}
+
+// Give up to n pages of unused buffers back to kalloc().
+// Returns the number of pages freed.
+int
+bshrink(int n)
+{
+  struct bufpage **pp, *pg;
+  int freed = 0;
 
   acquire(&bcache.lock);
+  pp = &bcache.pages;
+  while(freed < n && bcache.npages > bcache.minpages && (pg = *pp) != 0){
+    if(bfreepage(pg)){
+      *pp = pg->next;
+      bcache.npages--;
+      kfree(pg);
+      freed++;
+    } else {
+      pp = &pg->next;
+    }
+  }
+  release(&bcache.lock);
+  return freed;
+}
 
-  // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+// Look for block blockno on device dev in bucket bk.
+// If found, take a reference to it.
+// bk->lock must be held.
+static struct buf*
+bfind(struct bucket *bk, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = bk->head; b; b = b->next){
     if(b->dev == dev && b->blockno == blockno){
+      if(b->hot)
+        b->ref = 1;
+      else if(b->seen && b->refcnt == 0 && bcache.clock - b->lastuse > NCORREL)
+        b->hot = 1;
       b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
+      b->nuse++;
       return b;
     }
   }
+  return 0;
+}
 
-  // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
+// Choose an unused buffer to recycle and take it off its
+// replacement queue. Returns with the lock of the buffer's
+// bucket held, in *bkp. Returns 0 if the BSCAN buffers it
+// looked at were all in use; the ones it passed over are at
+// the back of their queues, so the next call looks further on.
+// bcache.lock must be held.
+static struct buf*
+bvictim(struct bucket **bkp)
+{
+  struct bufq *cold = &bcache.q[COLD], *hot = &bcache.q[HOT];
+  struct bucket *bk;
+  struct buf *b;
+  int i, qn;
+
+  for(i = 0; i < BSCAN; i++){
+    qn = (cold->n > (cold->n + hot->n) / 4 || hot->n == 0) ? COLD : HOT;
+    if((b = bcache.q[qn].head) == 0)
+      break;
+    qremove(b);
+    bk = bhash(b->dev, b->blockno);
+    acquire(&bk->lock);
+    if(qn == COLD && b->hot){
+      // re-used while cold: promote.
+      b->ref = 0;
+      qinsert(HOT, b, 0);
+    } else if(b->refcnt != 0){
+      qinsert(qn, b, 0);
+    } else if(qn == HOT && b->ref){
+      // give it another trip around the clock.
+      b->ref = 0;
+      qinsert(HOT, b, 0);
+    } else if(qn == HOT){
+      // not used for a whole trip: demote.
+      b->hot = 0;
+      qinsert(COLD, b, 0);
+    } else {
+      *bkp = bk;
+      return b;
+    }
+    release(&bk->lock);
+  }
+  return 0;
+}
+
+// Look through buffer cache for block on device dev.
+// If not found, allocate a buffer.
+// In either case, return locked buffer.
+static struct buf*
+bget(uint dev, uint blockno)
+{
+  struct bucket *bk = bhash(dev, blockno);
+  struct bucket *vbk;
+  struct buf *b;
+  int scanned;
+
+  // Is the block already cached?
+  BCOUNT(blockno, lookups);
+  acquire(&bk->lock);
+  b = bfind(bk, dev, blockno);
+  release(&bk->lock);
+  if(b){
+    BCOUNT(blockno, hits);
+    if(b->lock.locked)
+      BCOUNT(blockno, waits);
+    acquiresleep(&b->lock);
+    return b;
+  }
+
+  // Not cached. Add buffers if the cache may grow.
+  bgrow();
+
+  // Another process may recycle a buffer for
+  // the same block while we wait for bcache.lock, so check
+  // again once we hold it.
+  for(scanned = 0; ; scanned += BSCAN){
+    acquire(&bcache.lock);
+    acquire(&bk->lock);
+    if((b = bfind(bk, dev, blockno)) != 0){
+      release(&bk->lock);
       release(&bcache.lock);
+      BCOUNT(blockno, hits);
+      if(b->lock.locked)
+        BCOUNT(blockno, waits);
       acquiresleep(&b->lock);
       return b;
     }
+    release(&bk->lock);
+    if((b = bvictim(&vbk)) != 0)
+      break;
+    // all in use so far; let their holders run.
+    if(scanned > 4 * (bcache.q[COLD].n + bcache.q[HOT].n))
+      panic("bget: no buffers");
+    release(&bcache.lock);
+    yield();
   }
-  panic("bget: no buffers");
+  BCOUNT(blockno, misses);
+
+  // Recycle the unused buffer; it starts out cold.
+  if(b->valid)
+    BCOUNT(b->blockno, evictions);
+  b->dev = dev;
+  b->blockno = blockno;
+  b->valid = 0;
+  b->refcnt = 1;
+  b->hot = 0;
+  b->ref = 0;
+  b->seen = 0;
+  b->nuse = 1;
+  b->lastuse = bcache.clock;
+  if(vbk != bk){
+    bunlink(vbk, b);
+    release(&vbk->lock);
+    acquire(&bk->lock);
+    blink(bk, b);
+    release(&bk->lock);
+  } else {
+    release(&vbk->lock);
+  }
+  qinsert(COLD, b, 0);
+  release(&bcache.lock);
+  acquiresleep(&b->lock);
+  return b;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -96,58 +517,323 @@ bread(uint dev, uint blockno)
 
   b = bget(dev, blockno);
   if(!b->valid) {
-    virtio_disk_rw(b, 0);
+    // a read-ahead of b may be in flight already.
+    if(!b->disk){
+      BCOUNT(blockno, reads);
+      iosubmit(&b, 1, 0, 0);
+    }
+    virtio_disk_wait(b);
     b->valid = 1;
+    if(myproc())
+      myproc()->usage.inblock++;
   }
   return b;
 }
 
+// Return a locked buf for the indicated block without reading
+// it from disk, for a caller that will overwrite all of it.
+struct buf*
+bgetnew(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  // a read-ahead of b may be in flight.
+  if(b->disk)
+    virtio_disk_wait(b);
+  b->valid = 1;
+  return b;
+}
+
+// Return locked bufs in bs[0..n-1] with the contents of the n
+// blocks from blockno on, reading the ones not cached with as
+// few disk requests as possible.
+void
+bread_range(uint dev, uint blockno, int n, struct buf **bs)
+{
+  struct buf *rd[MAXRANGE];
+  int i, nrd = 0;
+
+  if(n > MAXRANGE)
+    panic("bread_range");
+  for(i = 0; i < n; i++){
+    bs[i] = bget(dev, blockno + i);
+    if(!bs[i]->valid && !bs[i]->disk){
+      BCOUNT(blockno + i, reads);
+      rd[nrd++] = bs[i];
+    }
+  }
+  if(nrd > 0)
+    iosubmit(rd, nrd, 0, 0);
+  // wait for the last first, so that the driver can ask
+  // for a single interrupt for the lot.
+  for(i = n-1; i >= 0; i--){
+    if(!bs[i]->valid){
+      virtio_disk_wait(bs[i]);
+      bs[i]->valid = 1;
+    }
+  }
+  if(myproc())
+    myproc()->usage.inblock += nrd;
+}
+
+// Add delta to b's reference count.
+static void
+bhold(struct buf *b, int delta)
+{
+  struct bucket *bk = bhash(b->dev, b->blockno);
+
+  acquire(&bk->lock);
+  b->refcnt += delta;
+  release(&bk->lock);
+}
+
+// Start reading the n blocks from blockno on into the cache in
+// the background, skipping ones that are cached already.
+// Returns the number of blocks dealt with before the disk
+// became too busy to take more.
+int
+breadahead(uint dev, uint blockno, int n)
+{
+  struct buf *b, *rd[MAXRANGE];
+  int i, nrd = 0, queued, done;
+
+  if(n > MAXRANGE)
+    n = MAXRANGE;
+  for(i = 0; i < n; i++){
+    b = bget(dev, blockno + i);
+    if(b->valid || b->disk){
+      brelse(b);
+      continue;
+    }
+    // the read holds a reference of its own, which
+    // breaddone() drops.
+    bhold(b, 1);
+    b->iodone = breaddone;
+    rd[nrd++] = b;
+  }
+  queued = nrd > 0 ? iosubmit(rd, nrd, 0, 1) : 0;
+  for(i = 0; i < queued; i++)
+    BCOUNT(rd[i]->blockno, reads);
+  done = queued < nrd ? rd[queued]->blockno - blockno : n;
+
+  // a bread() of a block meanwhile waits for its read to finish.
+  for(i = 0; i < nrd; i++){
+    if(i >= queued){
+      rd[i]->iodone = 0;
+      bhold(rd[i], -1);
+    }
+    brelse(rd[i]);
+  }
+  if(myproc())
+    myproc()->usage.inblock += queued;
+  return done;
+}
+
+// Called by virtio_disk_intr() when a read-ahead finishes.
+void
+breaddone(struct buf *b)
+{
+  struct bucket *bk = bhash(b->dev, b->blockno);
+
+  b->iodone = 0;
+  acquire(&bk->lock);
+  b->valid = 1;
+  b->refcnt--;
+  if(b->refcnt == 0)
+    b->lastuse = __sync_fetch_and_add(&bcache.clock, 1);
+  release(&bk->lock);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
 {
   if(!holdingsleep(&b->lock))
     panic("bwrite");
-  virtio_disk_rw(b, 1);
+  BCOUNT(b->blockno, writes);
+  iosubmit(&b, 1, 1, 0);
+  virtio_disk_wait(b);
+  if(myproc())
+    myproc()->usage.oublock++;
+}
+
+// Write the n bufs in bs to disk, keeping the disk busy with
+// all of them at once, and wait for them all.  Must be locked.
+void
+bwritev(struct buf **bs, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    if(!holdingsleep(&bs[i]->lock))
+      panic("bwritev");
+    BCOUNT(bs[i]->blockno, writes);
+  }
+  iosubmit(bs, n, 1, 0);
+  // last first, as in bread_range().
+  for(i = n-1; i >= 0; i--)
+    virtio_disk_wait(bs[i]);
+  if(myproc())
+    myproc()->usage.oublock += n;
 }
 
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// Record when it was last used, for replacement.
 void
 brelse(struct buf *b)
 {
+  struct bucket *bk;
+
   if(!holdingsleep(&b->lock))
     panic("brelse");
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
+  bk = bhash(b->dev, b->blockno);
+  acquire(&bk->lock);
   b->refcnt--;
   if (b->refcnt == 0) {
     // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->lastuse = __sync_fetch_and_add(&bcache.clock, 1);
+    b->seen = 1;
+  }
+  release(&bk->lock);
+}
+
+// Release a locked buffer whose contents the caller has copied
+// somewhere it will keep them, such as the page cache. If nobody
+// else is using it, forget the block and put the buffer first in
+// line for recycling, so the data isn't cached twice.
+void
+bforget(struct buf *b)
+{
+  struct bucket *bk;
+
+  if(!holdingsleep(&b->lock))
+    panic("bforget");
+
+  releasesleep(&b->lock);
+
+  acquire(&bcache.lock);
+  bk = bhash(b->dev, b->blockno);
+  acquire(&bk->lock);
+  b->refcnt--;
+  if(b->refcnt == 0 && !b->disk){
+    b->valid = 0;
+    b->hot = 0;
+    qremove(b);
+    qinsert(COLD, b, 1);
+  } else if(b->refcnt == 0){
+    b->lastuse = __sync_fetch_and_add(&bcache.clock, 1);
+    b->seen = 1;
   }
-  
+  release(&bk->lock);
   release(&bcache.lock);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = bhash(b->dev, b->blockno);
+
+  BCOUNT(b->blockno, pins);
+  acquire(&bk->lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = bhash(b->dev, b->blockno);
+
+  acquire(&bk->lock);
   b->refcnt--;
+  release(&bk->lock);
+}
+
+// Copy the cache's counters out to addr.
+int
+bstat_read(uint64 addr)
+{
+  struct bcachestat st;
+
+  memmove(st.class, bcache.stat, sizeof(st.class));
+  acquire(&bcache.lock);
+  st.nbuf = bcache.q[COLD].n + bcache.q[HOT].n;
+  st.nhot = bcache.q[HOT].n;
+  st.maxbuf = bcache.maxpages * BPP;
+  st.nbucket = bcache.nbucket;
   release(&bcache.lock);
+  return copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st));
 }
 
+// Copy out the up to n cached blocks with the most lookups
+// since they were read, most used first.
+// Returns the number copied out, or -1.
+int
+bstat_hot(uint64 addr, int n)
+{
+  struct bheat *h;
+  struct bufpage *pg;
+  struct buf *b;
+  int i, nh = 0;
+  int max = PGSIZE / sizeof(struct bheat);
+
+  if(n > max)
+    n = max;
+  if(n <= 0 || (h = (struct bheat *)kalloc()) == 0)
+    return -1;
+
+  // bcache.lock keeps buffers from changing blocks.
+  acquire(&bcache.lock);
+  for(pg = bcache.pages; pg; pg = pg->next){
+    for(b = pg->buf; b < pg->buf+BPP; b++){
+      if(!b->valid)
+        continue;
+      // insert into h, sorted by uses, keeping the top n.
+      for(i = nh; i > 0 && h[i-1].uses < b->nuse; i--)
+        if(i < n)
+          h[i] = h[i-1];
+      if(i < n){
+        h[i].dev = b->dev;
+        h[i].blockno = b->blockno;
+        h[i].class = bclass(b->blockno);
+        h[i].uses = b->nuse;
+        if(nh < n)
+          nh++;
+      }
+    }
+  }
+  release(&bcache.lock);
 
+  if(copyout(myproc()->pagetable, addr, (char *)h, nh * sizeof(*h)) < 0)
+    nh = -1;
+  kfree(h);
+  return nh;
+}
+
+// Zero the counters.
+void
+bstat_reset(void)
+{
+  memset(bcache.stat, 0, sizeof(bcache.stat));
+}
+
+// Forget the contents of every cached block that nobody is
+// using, so the next bread() of it goes to the disk. Blocks
+// the log has pinned have references, and stay.
+void
+bstat_drop(void)
+{
+  struct bucket *bk;
+  struct buf *b;
+
+  for(int i = 0; i < bcache.nbucket; i++){
+    bk = bucket(i);
+    acquire(&bk->lock);
+    for(b = bk->head; b; b = b->next)
+      if(b->refcnt == 0 && !b->disk)
+        b->valid = 0;
+    release(&bk->lock);
+  }
+}
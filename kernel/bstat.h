@@ -0,0 +1,43 @@
+// Buffer cache statistics, as returned by bstat().
+// Both the kernel and user programs use this header file.
+
+#define BSTAT_READ   0   // copy out a struct bcachestat
+#define BSTAT_HOT    1   // copy out the most used cached blocks
+#define BSTAT_RESET  2   // zero the counters
+#define BSTAT_DROP   3   // forget cached blocks and pages nobody is using
+
+// Block classes, from the superblock's layout.
+#define BC_SUPER   0     // boot block and superblock
+#define BC_LOG     1
+#define BC_INODE   2
+#define BC_BITMAP  3
+#define BC_DATA    4
+#define NBCLASS    5
+
+struct bstat {
+  uint64 lookups;    // bread()s and read-aheads of the block
+  uint64 hits;       // lookups that found it cached
+  uint64 misses;     // lookups that didn't
+  uint64 evictions;  // times it was recycled for another block
+  uint64 reads;      // disk reads
+  uint64 writes;     // bwrite()s
+  uint64 pins;       // bpin()s by the log
+  uint64 waits;      // lookups that found the buffer locked
+};
+
+struct bcachestat {
+  struct bstat class[NBCLASS];
+  int nbuf;          // buffers in the cache
+  int nhot;          // ... on the hot queue
+  int maxbuf;        // most buffers the cache may grow to
+  int nbucket;       // hash buckets, sized from maxbuf
+};
+
+// A cached block and how many lookups it has had since
+// it was read into the cache.
+struct bheat {
+  uint dev;
+  uint blockno;
+  int class;
+  uint64 uses;
+};
@@ -1,12 +1,23 @@
 struct buf {
   int valid;   // has data been read from disk?
   int disk;    // does disk "own" buf?
+  void (*iodone)(struct buf *); // if set, called when the disk is done
+  struct buf *ionext; // next in the same disk request, or I/O scheduler queue
+  uchar iowait;       // processes sleeping in virtio_disk_wait() for it
   uint dev;
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
+  uint64 lastuse;   // when refcnt last fell to zero
+  struct buf *prev; // hash bucket chain
   struct buf *next;
+  char queue;       // replacement queue the buf is on
+  char hot;         // has been re-used; belongs on the hot queue
+  char ref;         // hot: used since the clock hand last passed
+  char seen;        // released by a user since it was read
+  uint64 nuse;      // lookups since it was read, for bstat()
+  struct buf *qprev; // replacement queue
+  struct buf *qnext;
   uchar data[BSIZE];
 };
 
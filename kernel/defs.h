@@ -1,21 +1,35 @@
 struct buf;
 struct context;
+struct diskstat;
 struct file;
 struct inode;
 struct pipe;
 struct proc;
 struct spinlock;
 struct sleeplock;
+struct seqlock;
 struct stat;
 struct superblock;
+struct usage;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+struct buf*     bgetnew(uint, uint);
 void            brelse(struct buf*);
+void            bforget(struct buf*);
 void            bwrite(struct buf*);
+void            bwritev(struct buf**, int);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+int             bshrink(int);
+int             breadahead(uint, uint, int);
+void            bread_range(uint, uint, int, struct buf**);
+void            breaddone(struct buf*);
+int             bstat_read(uint64);
+int             bstat_hot(uint64, int);
+void            bstat_reset(void);
+void            bstat_drop(void);
 
 // console.c
 void            consoleinit(void);
@@ -32,6 +46,7 @@ struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
+int             filelockstat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
 
 // fs.c
@@ -45,6 +60,11 @@ void            ilock(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
+void            ilockshared(struct inode*);
+void            iunlockshared(struct inode*);
+int             ireadahead(struct inode*, uint, uint);
+int             pcshrink(void);
+uint            bmap(struct inode*, uint);
 void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
@@ -55,22 +75,37 @@ int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
 void            ireclaim(int);
 
+// futex.c
+void            futexinit(void);
+int             futexwait(uint64, uint32);
+int             futexwake(uint64, int);
+
 // kalloc.c
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+int             kfreepages(void);
 
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
+void            log_sync(void);
+
+// pcache.c
+void            pcacheinit(void);
+char*           pcpage(struct inode*, uint);
+int             pccached(struct inode*, uint);
+void            pcwrite(struct inode*, uint, char*, uint);
+void            pcdrop(struct inode*);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
 int             pipewrite(struct pipe*, uint64, int);
+int             pipelockstat(struct pipe*, uint64);
 
 // printf.c
 int             printf(char*, ...) __attribute__ ((format (printf, 1, 2)));
@@ -81,11 +116,14 @@ void            printfinit(void);
 int             cpuid(void);
 void            kexit(int);
 int             kfork(void);
+int             kthread(void (*)(void), char*);
 int             growproc(int);
-void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kkill(int);
+int             setaffinity(int, int);
+int             getaffinity(int);
+int             getusage(int, struct usage*);
 int             killed(struct proc*);
 void            setkilled(struct proc*);
 struct cpu*     mycpu(void);
@@ -95,8 +133,9 @@ void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
-int             kwait(uint64);
+int             kwait(int, uint64, int);
 void            wakeup(void*);
+int             wakeupn(void*, int);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
@@ -112,10 +151,30 @@ void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
+void            freelock(struct spinlock*);
+int             lockstat_read(uint64, int);
+void            lockstat_reset(void);
+int             lockstat_lock(struct spinlock*, uint64);
+void            writeseqbegin(struct seqlock*);
+void            writeseqend(struct seqlock*);
+uint            readseqbegin(struct seqlock*);
+int             readseqretry(struct seqlock*, uint);
+
+// shm.c
+void            shminit(void);
+int             shmget(int, int);
+uint64          shmat(int);
+int             shmdt(uint64);
+int             shmrm(int);
+int             shmcopy(pagetable_t, pagetable_t);
+void            shmunmapall(pagetable_t);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
+int             tryacquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
+void            acquiresleepshared(struct sleeplock*);
+void            releasesleepshared(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
@@ -141,6 +200,7 @@ extern uint     ticks;
 void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
+uint            readticks(void);
 void            prepare_return(void);
 
 // uart.c
@@ -154,6 +214,8 @@ int             uartgetc(void);
 void            kvminit(void);
 void            kvminithart(void);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
+int             kvmalloc(uint64);
+void            kvmsync(void);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
 uint64          uvmalloc(pagetable_t, uint64, uint64, int);
@@ -176,9 +238,17 @@ void            plicinithart(void);
 int             plic_claim(void);
 void            plic_complete(int);
 
+// iosched.c
+void            ioschedinit(void);
+int             iosubmit(struct buf **, int, int, int);
+void            iokick(void);
+void            iosched_stat(struct diskstat *);
+
 // virtio_disk.c
 void            virtio_disk_init(void);
-void            virtio_disk_rw(struct buf *, int);
+int             virtio_disk_submit(struct buf **, int, int);
+void            virtio_disk_wait(struct buf *);
+int             virtio_disk_stat(int, uint64, int);
 void            virtio_disk_intr(void);
 
 // number of elements in fixed-size array
@@ -0,0 +1,48 @@
+// Disk driver statistics, as returned by diskstat().
+// Both the kernel and user programs use this header file.
+
+#define DISKSTAT_READ   0   // copy out a struct diskstat
+#define DISKSTAT_RESET  1   // zero the counters
+#define DISKSTAT_POLL   2   // set the polling budget to n microseconds
+#define DISKSTAT_TRACE  3   // n=1: start tracing afresh; n=0: stop
+#define DISKSTAT_DUMP   4   // take up to n struct disktrace, oldest first
+
+#define NLAT   20           // latency histogram buckets
+#define DIRECTSEG 6         // most blocks in a request without indirect
+                            // descriptors, so that one takes at most 8
+                            // of the ring's descriptors
+#define NTRACE 128          // trace records kept
+
+struct diskstat {
+  uint64 requests;    // requests sent to the device
+  uint64 notifies;    // doorbell writes
+  uint64 interrupts;  // disk interrupts taken
+  uint64 intr;        // completions found by interrupts or submitters
+  uint64 polled;      // completions found by a polling waiter
+  uint64 pollhit;     // waits whose request a poll completed
+  uint64 pollmiss;    // waits that polled in vain, then slept
+  uint64 queued;      // bufs handed to the I/O scheduler
+  uint64 merged;      // bufs sent in a request with a neighbour
+  uint64 depthsum;    // sum of the scheduler's depth as each buf arrived
+  int depth;          // bufs waiting in the scheduler now
+  int maxdepth;       // most bufs ever waiting in the scheduler
+  uint64 lat[2][NLAT]; // requests by latency, reads and writes:
+                      // lat[w][i] took 2^i to 2^(i+1) microseconds,
+                      // lat[w][0] less than 2.
+  int pollus;         // polling budget (microseconds); 0 is off
+  int indirect;       // device takes indirect descriptor tables
+  int eventidx;       // device suppresses notifies and interrupts
+  int maxseg;         // most blocks in one request
+  int tracing;        // requests are being traced
+  int tracelost;      // trace records overwritten before a dump
+};
+
+// one finished request, as recorded by DISKSTAT_TRACE.
+struct disktrace {
+  uint64 when;        // completion time, microseconds since boot
+  uint64 sector;
+  int nblocks;
+  int write;
+  int depth;          // requests at the device, including this one
+  int latency;        // microseconds from submission to completion
+};
@@ -35,6 +35,9 @@ filealloc(void)
   for(f = ftable.file; f < ftable.file + NFILE; f++){
     if(f->ref == 0){
       f->ref = 1;
+      f->ranext = 0;
+      f->rawin = 0;
+      f->rablock = 0;
       release(&ftable.lock);
       return f;
     }
@@ -91,9 +94,9 @@ filestat(struct file *f, uint64 addr)
   struct stat st;
   
   if(f->type == FD_INODE || f->type == FD_DEVICE){
-    ilock(f->ip);
+    ilockshared(f->ip);
     stati(f->ip, &st);
-    iunlock(f->ip);
+    iunlockshared(f->ip);
     if(copyout(p->pagetable, addr, (char *)&st, sizeof(st)) < 0)
       return -1;
     return 0;
@@ -101,6 +104,54 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
+// Copy out the statistics of the lock behind file f, which
+// must be a pipe, to the struct lockstat at addr.
+int
+filelockstat(struct file *f, uint64 addr)
+{
+  if(f->type == FD_PIPE)
+    return pipelockstat(f->pipe, addr);
+  return -1;
+}
+
+// Read from inode file f at f->off, and read ahead if f is
+// being read sequentially, doubling the read-ahead window on
+// each sequential read up to NREADAHEAD blocks.
+// Caller must hold f->ip->lock.
+static int
+readinode(struct file *f, uint64 addr, int n)
+{
+  uint bn, end;
+  int r;
+
+  if((r = readi(f->ip, 1, addr, f->off, n)) <= 0)
+    return r;
+
+  if(f->off == f->ranext){
+    if(f->rawin == 0)
+      f->rawin = 4;
+    else if(f->rawin < NREADAHEAD)
+      f->rawin *= 2;
+    if(f->rawin > NREADAHEAD)
+      f->rawin = NREADAHEAD;
+  } else {
+    f->rawin = 0;
+    f->rablock = 0;
+  }
+  f->off += r;
+  f->ranext = f->off;
+
+  if(f->rawin){
+    bn = f->off / BSIZE;
+    end = bn + f->rawin;
+    if(f->rablock > bn)
+      bn = f->rablock;
+    if(bn < end)
+      f->rablock = bn + ireadahead(f->ip, bn, end - bn);
+  }
+  return r;
+}
+
 // Read from file f.
 // addr is a user virtual address.
 int
@@ -118,10 +169,19 @@ fileread(struct file *f, uint64 addr, int n)
       return -1;
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
-      f->off += r;
-    iunlock(f->ip);
+    // f->off and the read-ahead state are protected by the
+    // inode lock. If no other process shares f, nobody else
+    // can touch them, and the lock can be shared with other
+    // readers of the inode.
+    if(f->ref == 1){
+      ilockshared(f->ip);
+      r = readinode(f, addr, n);
+      iunlockshared(f->ip);
+    } else {
+      ilock(f->ip);
+      r = readinode(f, addr, n);
+      iunlock(f->ip);
+    }
   } else {
     panic("fileread");
   }
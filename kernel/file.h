@@ -6,6 +6,9 @@ struct file {
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE
+  uint ranext;       // FD_INODE: off a sequential read would start at
+  uint rawin;        // FD_INODE: read-ahead window, in blocks
+  uint rablock;      // FD_INODE: read-ahead has started up to here
   short major;       // FD_DEVICE
 };
 
@@ -27,6 +30,9 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+1];
+
+  void **pcroot;      // page cache radix tree; see pcache.c
+  int pcheight;       // ... and its height
 };
 
 // map major device number to device functions.
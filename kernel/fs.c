@@ -154,6 +154,10 @@ bfree(int dev, uint b)
 //   iunlock(ip)
 //   iput(ip)
 //
+// Code that only examines an inode can lock it shared with
+// ilockshared()/iunlockshared() instead, so that reads and
+// lookups of the same file or directory run in parallel.
+//
 // ilock() is separate from iget() so that system calls can
 // get a long-term reference to an inode (as for an open file)
 // and only lock it for short periods (e.g., in read()).
@@ -251,15 +255,18 @@ iget(uint dev, uint inum)
 
   acquire(&itable.lock);
 
-  // Is the inode already in the table?
+  // Is the inode already in the table? An entry nobody
+  // refers to is still valid, and its pages still cached,
+  // until it is recycled.
   empty = 0;
   for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+    if((ip->ref > 0 || ip->valid) && ip->dev == dev && ip->inum == inum){
       ip->ref++;
       release(&itable.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
+    // Remember empty slot, preferring one not holding an inode.
+    if(ip->ref == 0 && (empty == 0 || (empty->valid && !ip->valid)))
       empty = ip;
   }
 
@@ -268,6 +275,7 @@ iget(uint dev, uint inum)
     panic("iget: no inodes");
 
   ip = empty;
+  pcdrop(ip);
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
@@ -327,6 +335,34 @@ iunlock(struct inode *ip)
   releasesleep(&ip->lock);
 }
 
+// Lock the given inode shared, for reading only.
+// Reads the inode from disk if necessary.
+// A valid inode stays valid while the caller holds a reference,
+// so loading it under an exclusive lock first is enough.
+void
+ilockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilockshared");
+
+  if(ip->valid == 0){
+    ilock(ip);
+    iunlock(ip);
+  }
+  acquiresleepshared(&ip->lock);
+  if(ip->valid == 0)
+    panic("ilockshared: not valid");
+}
+
+void
+iunlockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("iunlockshared");
+
+  releasesleepshared(&ip->lock);
+}
+
 // Drop a reference to an in-memory inode.
 // If that was the last reference, the inode table entry can
 // be recycled.
@@ -402,7 +438,7 @@ ireclaim(int dev)
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
 // returns 0 if out of disk space.
-static uint
+uint
 bmap(struct inode *ip, uint bn)
 {
   uint addr, *a;
@@ -471,10 +507,53 @@ itrunc(struct inode *ip)
     ip->addrs[NDIRECT] = 0;
   }
 
+  pcdrop(ip);
   ip->size = 0;
   iupdate(ip);
 }
 
+// Free cached pages, first those of inodes that nobody is
+// using, then if there were none, those of open inodes whose
+// lock is free. Pages are never dirty, since writei() writes
+// through, and a page being filled isn't in the tree until it
+// is full, so any page in the tree may go. Holding ip->lock
+// keeps readers from using the pages meanwhile; the lock is
+// only tried, since the caller may hold an inode lock itself.
+// Open inodes are left alone if the caller holds a spinlock:
+// releasing ip->lock wakes waiters, which takes proc locks,
+// and allocproc() calls kalloc() holding one.
+// Called by kalloc() when memory runs out.
+// Returns the number of inodes whose pages were freed.
+int
+pcshrink(void)
+{
+  struct inode *ip;
+  int n = 0, canlock;
+
+  push_off();
+  canlock = myproc() != 0 && mycpu()->noff == 1;
+  pop_off();
+
+  acquire(&itable.lock);
+  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
+    if(ip->ref == 0 && ip->pcroot){
+      pcdrop(ip);
+      n++;
+    }
+  }
+  if(n == 0 && canlock){
+    for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
+      if(ip->ref > 0 && ip->pcroot && tryacquiresleep(&ip->lock)){
+        pcdrop(ip);
+        releasesleep(&ip->lock);
+        n++;
+      }
+    }
+  }
+  release(&itable.lock);
+  return n;
+}
+
 // Copy stat information from inode.
 // Caller must hold ip->lock.
 void
@@ -496,6 +575,7 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 {
   uint tot, m;
   struct buf *bp;
+  char *pa;
 
   if(off > ip->size || off + n < off)
     return 0;
@@ -503,6 +583,16 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
     n = ip->size - off;
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    // regular files' data comes from the page cache,
+    // unless memory is short.
+    if(ip->type == T_FILE && (pa = pcpage(ip, off/PGSIZE)) != 0){
+      m = min(n - tot, PGSIZE - off%PGSIZE);
+      if(either_copyout(user_dst, dst, pa + (off % PGSIZE), m) == -1) {
+        tot = -1;
+        break;
+      }
+      continue;
+    }
     uint addr = bmap(ip, off/BSIZE);
     if(addr == 0)
       break;
@@ -518,6 +608,48 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   return tot;
 }
 
+// Start reading up to n blocks of ip's content, from block bn
+// on, into the buffer cache in the background.
+// Caller must hold ip->lock, perhaps shared.
+// Blocks that are consecutive on disk are read in one request.
+// Blocks whose page is in the page cache are skipped; readi()
+// gets them from there.
+// Returns the number of blocks dealt with before the disk
+// became too busy to take more.
+int
+ireadahead(struct inode *ip, uint bn, uint n)
+{
+  uint addr, i, k, done;
+  uint nb = (ip->size + BSIZE - 1) / BSIZE;
+  uint bpp = PGSIZE / BSIZE;
+
+  if(bn >= nb)
+    return 0;
+  if(n > nb - bn)
+    n = nb - bn;
+  for(i = 0; i < n; i += k){
+    if(pccached(ip, (bn + i) / bpp)){
+      // skip the rest of the page.
+      k = bpp - (bn + i) % bpp;
+      if(k > n - i)
+        k = n - i;
+      continue;
+    }
+    if((addr = bmap(ip, bn + i)) == 0)
+      break;
+    for(k = 1; i + k < n; k++){
+      if(bmap(ip, bn + i + k) != addr + k)
+        break;
+      if((bn + i + k) % bpp == 0 && pccached(ip, (bn + i + k) / bpp))
+        break;
+    }
+    done = breadahead(ip->dev, addr, k);
+    if(done < k)
+      return i + done;
+  }
+  return i;
+}
+
 // Write data to inode.
 // Caller must hold ip->lock.
 // If user_src==1, then src is a user virtual address;
@@ -546,6 +678,8 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
       brelse(bp);
       break;
     }
+    if(ip->type == T_FILE)
+      pcwrite(ip, off, (char *)bp->data + (off % BSIZE), m);
     log_write(bp);
     brelse(bp);
   }
@@ -682,21 +816,22 @@ namex(char *path, int nameiparent, char *name)
     ip = idup(myproc()->cwd);
 
   while((path = skipelem(path, name)) != 0){
-    ilock(ip);
+    ilockshared(ip);
     if(ip->type != T_DIR){
-      iunlockput(ip);
+      iunlockshared(ip);
+      iput(ip);
       return 0;
     }
     if(nameiparent && *path == '\0'){
       // Stop one level early.
-      iunlock(ip);
+      iunlockshared(ip);
       return ip;
     }
-    if((next = dirlookup(ip, name, 0)) == 0){
-      iunlockput(ip);
+    next = dirlookup(ip, name, 0);
+    iunlockshared(ip);
+    iput(ip);
+    if(next == 0)
       return 0;
-    }
-    iunlockput(ip);
     ip = next;
   }
   if(nameiparent){
@@ -0,0 +1,104 @@
+//
+// Fast user-space mutexes.
+//
+// A futex is just a 32-bit word in user memory. User code
+// manipulates the word with atomic instructions and only enters
+// the kernel when it has to block (futex_wait) or when it might
+// have to wake a blocked process (futex_wake).
+//
+// Waiters are keyed by the physical address of the word, so two
+// processes that map the same page at different virtual addresses
+// still rendezvous. The key is hashed to a bucket; the bucket's
+// spinlock is the condition lock passed to sleep(), which closes
+// the window between checking the word and going to sleep.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "proc.h"
+
+#define NFUTEXBUCKET 31
+
+struct {
+  struct spinlock lock[NFUTEXBUCKET];
+} futextab;
+
+void
+futexinit(void)
+{
+  for(int i = 0; i < NFUTEXBUCKET; i++)
+    initlock(&futextab.lock[i], "futex");
+}
+
+static struct spinlock*
+futexbucket(uint64 pa)
+{
+  return &futextab.lock[(pa >> 2) % NFUTEXBUCKET];
+}
+
+// Translate the user address of a futex word into the physical
+// address that identifies it, faulting in a lazily-allocated page.
+// Returns 0 if uaddr is misaligned or not valid user memory.
+static uint64
+futexaddr(uint64 uaddr)
+{
+  struct proc *p = myproc();
+  uint64 va0, pa0;
+
+  if(uaddr % sizeof(uint32) != 0)
+    return 0;
+  va0 = PGROUNDDOWN(uaddr);
+  if((pa0 = walkaddr(p->pagetable, va0)) == 0)
+    if((pa0 = vmfault(p->pagetable, va0, 0)) == 0)
+      return 0;
+  return pa0 + (uaddr - va0);
+}
+
+// If the word at uaddr still holds val, sleep until a
+// futex_wake() on the same word.
+// Returns 0 after being woken, -1 if the word didn't hold
+// val, the address was bad, or the process was killed.
+int
+futexwait(uint64 uaddr, uint32 val)
+{
+  struct spinlock *lk;
+  uint64 pa;
+
+  if((pa = futexaddr(uaddr)) == 0)
+    return -1;
+  lk = futexbucket(pa);
+
+  acquire(lk);
+  if(*(volatile uint32 *)pa != val || killed(myproc())){
+    release(lk);
+    return -1;
+  }
+  sleep((void*)pa, lk);
+  release(lk);
+  // kill() wakes the sleeper too.
+  if(killed(myproc()))
+    return -1;
+  return 0;
+}
+
+// Wake at most n processes waiting on the word at uaddr.
+// Returns the number woken, or -1 if the address was bad.
+int
+futexwake(uint64 uaddr, int n)
+{
+  struct spinlock *lk;
+  uint64 pa;
+  int woken;
+
+  if((pa = futexaddr(uaddr)) == 0)
+    return -1;
+  lk = futexbucket(pa);
+
+  acquire(lk);
+  woken = wakeupn((void*)pa, n);
+  release(lk);
+  return woken;
+}
@@ -0,0 +1,178 @@
+//
+// I/O scheduler.
+//
+// An elevator between the buffer cache and the disk driver.
+// bio.c hands bufs to iosubmit(), which keeps them on a read
+// queue and a write queue, each sorted by block number, and
+// passes them on to the driver as long as the driver has free
+// descriptors, so the device gets as deep a queue as its ring
+// allows. Once the ring is full the rest wait here, where
+// bufs for neighbouring blocks that arrive later join them:
+// iodispatch() sends a buf together with the run of consecutive
+// blocks queued behind it as a single request.
+//
+// Reads go first, since a process is usually waiting for
+// them, but no more than RDBATCH requests in a row while
+// writes are waiting. Within a queue the elevator sweeps up
+// from the last block it sent, then wraps around to the lowest
+// (C-SCAN).
+//
+// A waiting buf has b->disk set, like one at the device, and
+// is linked through b->ionext, which the driver reuses for the
+// bufs of a request once the buf is sent. The driver calls
+// iokick() when requests finish, to send more.
+//
+// Lock order: iosched.lock, then the driver's vdisk_lock.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "diskstat.h"
+
+#define RDBATCH 8   // most reads in a row while writes wait
+#define MAXRUN  32  // most bufs sent in one go
+#define MAXPEND 64  // most bufs waiting, for iosubmit(nowait)
+
+struct {
+  struct spinlock lock;
+  struct buf *q[2];   // waiting reads and writes, by dev, blockno
+  int npend;          // bufs on q[0] and q[1]
+  uint dev;           // the elevator is at dev, blockno
+  uint blockno;
+  int nread;          // read requests sent in a row
+  struct diskstat stat;
+} iosched;
+
+void
+ioschedinit(void)
+{
+  initlock(&iosched.lock, "iosched");
+}
+
+// does b come before dev, blockno?
+static int
+before(struct buf *b, uint dev, uint blockno)
+{
+  return b->dev < dev || (b->dev == dev && b->blockno < blockno);
+}
+
+// add b to queue q in block order.
+static void
+ioinsert(struct buf **q, struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp = q; *pp && before(*pp, b->dev, b->blockno); pp = &(*pp)->ionext)
+    ;
+  b->ionext = *pp;
+  *pp = b;
+  b->disk = 1;
+
+  iosched.npend++;
+  iosched.stat.queued++;
+  iosched.stat.depthsum += iosched.npend;
+  if(iosched.npend > iosched.stat.maxdepth)
+    iosched.stat.maxdepth = iosched.npend;
+}
+
+// send waiting requests to the driver until it runs out of
+// descriptors.
+// caller must hold iosched.lock.
+static void
+iodispatch(void)
+{
+  struct buf *bs[MAXRUN], **pp, *b;
+  int w, n, sent;
+
+  while(1){
+    if(iosched.q[0] && (iosched.nread < RDBATCH || iosched.q[1] == 0))
+      w = 0;
+    else if(iosched.q[1])
+      w = 1;
+    else
+      return;
+
+    // the first buf at or past the elevator, else the lowest.
+    for(pp = &iosched.q[w]; *pp; pp = &(*pp)->ionext)
+      if(!before(*pp, iosched.dev, iosched.blockno))
+        break;
+    if(*pp == 0)
+      pp = &iosched.q[w];
+
+    // and the run of consecutive blocks behind it.
+    n = 0;
+    for(b = *pp; b && n < MAXRUN; b = b->ionext){
+      if(n > 0 && (b->dev != bs[n-1]->dev || b->blockno != bs[n-1]->blockno + 1))
+        break;
+      bs[n++] = b;
+    }
+
+    // the driver overwrites b->ionext of the bufs it takes.
+    if((sent = virtio_disk_submit(bs, n, w)) == 0)
+      return;  // ring is full; iokick() will retry.
+    *pp = sent < n ? bs[sent] : b;
+
+    iosched.npend -= sent;
+    iosched.stat.merged += sent - 1;
+    iosched.dev = bs[sent-1]->dev;
+    iosched.blockno = bs[sent-1]->blockno + 1;
+    iosched.nread = w ? 0 : iosched.nread + 1;
+    if(sent < n)
+      return;
+  }
+}
+
+// queue the n bufs in bs to be read, or written if write is
+// set, sending as many as the driver has room for. doesn't
+// wait; see virtio_disk_wait().
+// if nowait, stops once MAXPEND bufs are waiting.
+// returns the number of bufs queued.
+int
+iosubmit(struct buf **bs, int n, int write, int nowait)
+{
+  int i;
+
+  acquire(&iosched.lock);
+  for(i = 0; i < n; i++){
+    if(nowait && iosched.npend >= MAXPEND)
+      break;
+    ioinsert(&iosched.q[write != 0], bs[i]);
+  }
+  iodispatch();
+  release(&iosched.lock);
+  return i;
+}
+
+// called by the driver when the device has finished
+// requests, and may have room for more.
+void
+iokick(void)
+{
+  acquire(&iosched.lock);
+  iodispatch();
+  release(&iosched.lock);
+}
+
+// fill in the scheduler's part of st, or if st is 0,
+// reset the scheduler's counters.
+void
+iosched_stat(struct diskstat *st)
+{
+  acquire(&iosched.lock);
+  if(st == 0){
+    memset(&iosched.stat, 0, sizeof(iosched.stat));
+  } else {
+    st->queued = iosched.stat.queued;
+    st->merged = iosched.stat.merged;
+    st->depthsum = iosched.stat.depthsum;
+    st->maxdepth = iosched.stat.maxdepth;
+    st->depth = iosched.npend;
+  }
+  release(&iosched.lock);
+}
@@ -21,6 +21,7 @@ struct run {
 struct {
   struct spinlock lock;
   struct run *freelist;
+  int nfree;
 } kmem;
 
 void
@@ -59,24 +60,45 @@ kfree(void *pa)
   acquire(&kmem.lock);
   r->next = kmem.freelist;
   kmem.freelist = r;
+  kmem.nfree++;
   release(&kmem.lock);
 }
 
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
+// If no pages are free, asks the buffer cache and then the
+// page cache to give some back.
 void *
 kalloc(void)
 {
   struct run *r;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  for(;;){
+    acquire(&kmem.lock);
+    r = kmem.freelist;
+    if(r){
+      kmem.freelist = r->next;
+      kmem.nfree--;
+    }
+    release(&kmem.lock);
+    if(r || (bshrink(8) == 0 && pcshrink() == 0))
+      break;
+  }
 
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
   return (void*)r;
 }
+
+// Return the number of free pages.
+int
+kfreepages(void)
+{
+  int n;
+
+  acquire(&kmem.lock);
+  n = kmem.nfree;
+  release(&kmem.lock);
+  return n;
+}
@@ -0,0 +1,17 @@
+// Lock contention statistics, as returned by lockstat().
+// Both the kernel and user programs use this header file.
+
+#define LOCKSTAT_READ   0   // copy out stats, most contended first
+#define LOCKSTAT_RESET  1   // zero every lock's counters
+#define LOCKSTAT_FD     2   // copy out the lock of the pipe open as fd n
+
+// Counters of all spinlocks with the same name, summed.
+struct lockstat {
+  char name[16];
+  int nlocks;         // number of locks with this name
+  uint64 nacquire;    // acquire()s
+  uint64 ncontend;    // acquire()s that had to wait
+  uint64 nspin;       // spin iterations while waiting
+  uint64 waittime;    // time spent waiting (microseconds)
+  uint64 holdtime;    // time held (microseconds)
+};
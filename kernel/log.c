@@ -10,8 +10,8 @@
 // Simple logging that allows concurrent FS system calls.
 //
 // A log transaction contains the updates of multiple FS system
-// calls. The logging system only commits when there are
-// no FS system calls active. Thus there is never
+// calls. A transaction is only committed when there are
+// no FS system calls active in it. Thus there is never
 // any reasoning required about whether a commit might
 // write an uncommitted system call's updates to disk.
 //
@@ -19,21 +19,50 @@
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
 // But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// sleeps until the transaction has been handed off for commit.
+//
+// The log is double-buffered in memory: the last end_op() of
+// a transaction hands it to the commit thread, logthread(),
+// and new system calls start the next transaction while the
+// thread writes the previous one to disk. Before letting them
+// in, the thread locks the committing transaction's blocks in
+// the buffer cache, and it only unlocks each block once it has
+// been installed, so a system call of the next transaction
+// that wants to change one waits for it in bread(). Commits
+// happen one at a time, so the one on-disk log suffices.
+//
+// The thread holds many buffers at once, taken in log order,
+// which can't deadlock because it takes them all before any
+// system call of the next transaction begins, and afterwards
+// only takes buffers of the log itself, which nothing else
+// uses. The FS code that runs meanwhile outside a transaction
+// (lookups and reads) holds at most one buffer at a time.
+// Code that holds one buffer while waiting for another must
+// be inside a transaction, or this breaks.
+//
+// sync() waits for everything logged so far to be installed.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
 //   header block, containing block #s for block A, B, C, ...
+//     and a checksum of them and the blocks' contents
 //   block A
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// Log appends are synchronous. The header is written along
+// with the blocks, and a transaction has committed once all of
+// them are on disk; recovery ignores a header whose checksum
+// doesn't match, which is what a commit interrupted by a crash
+// leaves. A header isn't cleared after its transaction is
+// installed, since the next commit overwrites it, but only
+// once the commit thread has nothing left to do.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
 struct logheader {
   int n;
+  uint sum;
   int block[LOGBLOCKS];
 };
 
@@ -41,14 +70,19 @@ struct log {
   struct spinlock lock;
   int start;
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int committing;  // logthread() has a transaction, in clh.
+  int closing;     // no FS sys calls may begin; see begin_op().
+  uint handed;     // transactions handed to logthread()
+  uint done;       // ... and committed and installed
   int dev;
-  struct logheader lh;
+  struct logheader lh;  // the transaction sys calls are adding to
+  struct logheader clh; // the transaction being committed
 };
 struct log log;
 
 static void recover_from_log(void);
-static void commit();
+static void write_head(struct logheader *);
+static void logthread(void);
 
 void
 initlog(int dev, struct superblock *sb)
@@ -60,55 +94,113 @@ initlog(int dev, struct superblock *sb)
   log.start = sb->logstart;
   log.dev = dev;
   recover_from_log();
+  if(kthread(logthread, "logcommit") < 0)
+    panic("initlog: kthread");
 }
 
-// Copy committed blocks from log to their home location
-static void
-install_trans(int recovering)
+// FNV-1a hash of the n bytes at p, continuing from h.
+static uint
+fnv(uint h, void *p, int n)
+{
+  uchar *c = p;
+
+  while(n-- > 0)
+    h = (h ^ *c++) * 16777619;
+  return h;
+}
+
+// Checksum of header h's block list, to be continued
+// over the contents of the blocks, in order.
+static uint
+headsum(struct logheader *h)
+{
+  uint sum = fnv(2166136261, &h->n, sizeof(h->n));
+
+  return fnv(sum, h->block, h->n * sizeof(h->block[0]));
+}
+
+// Does the checksum in the on-disk header, read into log.lh,
+// match the log blocks?
+static int
+log_valid(void)
 {
-  int tail;
+  struct buf *lbuf[LOGBATCH];
+  int tail, i, n;
+  uint sum;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    if(recovering) {
-      printf("recovering tail %d dst %d\n", tail, log.lh.block[tail]);
+  sum = headsum(&log.lh);
+  for (tail = 0; tail < log.lh.n; tail += n) {
+    n = log.lh.n - tail;
+    if(n > LOGBATCH)
+      n = LOGBATCH;
+    bread_range(log.dev, log.start+tail+1, n, lbuf);
+    for (i = 0; i < n; i++) {
+      sum = fnv(sum, lbuf[i]->data, BSIZE);
+      brelse(lbuf[i]);
     }
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
-    brelse(lbuf);
-    brelse(dbuf);
   }
+  return sum == log.lh.sum;
 }
 
-// Read the log header from disk into the in-memory log header
+// Copy committed blocks from log to their home location,
+// LOGBATCH blocks at a time.
 static void
+install_trans(void)
+{
+  struct buf *lbuf[LOGBATCH], *dbuf[LOGBATCH];
+  int tail, i, n;
+
+  for (tail = 0; tail < log.lh.n; tail += n) {
+    n = log.lh.n - tail;
+    if(n > LOGBATCH)
+      n = LOGBATCH;
+    bread_range(log.dev, log.start+tail+1, n, lbuf); // read log blocks
+    for (i = 0; i < n; i++) {
+      printf("recovering tail %d dst %d\n", tail+i, log.lh.block[tail+i]);
+      dbuf[i] = bread(log.dev, log.lh.block[tail+i]); // read dst
+      memmove(dbuf[i]->data, lbuf[i]->data, BSIZE);  // copy block to dst
+      brelse(lbuf[i]);
+    }
+    bwritev(dbuf, n);  // write dsts to disk
+    for (i = 0; i < n; i++)
+      brelse(dbuf[i]);
+  }
+}
+
+// Read the log header from disk into the in-memory log header.
+// Returns 0, with an empty header, if its block count is
+// impossible, as from a torn or garbage write.
+static int
 read_head(void)
 {
   struct buf *buf = bread(log.dev, log.start);
   struct logheader *lh = (struct logheader *) (buf->data);
   int i;
+  if(lh->n < 0 || lh->n > LOGBLOCKS){
+    brelse(buf);
+    log.lh.n = 0;
+    return 0;
+  }
   log.lh.n = lh->n;
+  log.lh.sum = lh->sum;
   for (i = 0; i < log.lh.n; i++) {
     log.lh.block[i] = lh->block[i];
   }
   brelse(buf);
+  return 1;
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
+// Write the in-memory log header h to disk, on its own.
 static void
-write_head(void)
+write_head(struct logheader *h)
 {
-  struct buf *buf = bread(log.dev, log.start);
+  struct buf *buf = bgetnew(log.dev, log.start);
   struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  hb->n = h->n;
+  hb->sum = h->sum;
+  for (i = 0; i < h->n; i++) {
+    hb->block[i] = h->block[i];
   }
   bwrite(buf);
   brelse(buf);
@@ -117,10 +209,13 @@ write_head(void)
 static void
 recover_from_log(void)
 {
-  read_head();
-  install_trans(1); // if committed, copy from log to disk
+  if(!read_head() || (log.lh.n > 0 && !log_valid())){
+    printf("log: discarding incomplete commit\n");
+    log.lh.n = 0;
+  }
+  install_trans(); // if committed, copy from log to disk
   log.lh.n = 0;
-  write_head(); // clear the log
+  write_head(&log.lh); // clear the log
 }
 
 // called at the start of each FS system call.
@@ -129,7 +224,7 @@ begin_op(void)
 {
   acquire(&log.lock);
   while(1){
-    if(log.committing){
+    if(log.closing){
       sleep(&log, &log.lock);
     } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGBLOCKS){
       // this op might exhaust log space; wait for commit.
@@ -142,20 +237,31 @@ begin_op(void)
   }
 }
 
+// Give the current transaction to logthread(), and keep new
+// FS sys calls out until the thread has locked its blocks.
+// Caller must hold log.lock; there must be no outstanding
+// FS sys calls and no commit in progress.
+static void
+handoff(void)
+{
+  log.clh = log.lh;
+  log.lh.n = 0;
+  log.committing = 1;
+  log.closing = 1;
+  log.handed++;
+  wakeup(&log.clh);
+}
+
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// hands the transaction off for commit if this was the
+// last outstanding operation.
 void
 end_op(void)
 {
-  int do_commit = 0;
-
   acquire(&log.lock);
   log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
-  if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
+  if(log.outstanding == 0 && log.lh.n > 0 && !log.committing){
+    handoff();
   } else {
     // begin_op() may be waiting for log space,
     // and decrementing log.outstanding has decreased
@@ -163,49 +269,144 @@ end_op(void)
     wakeup(&log);
   }
   release(&log.lock);
+}
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
+// Copy the blocks in bs, which the commit thread has
+// locked, to the log, LOGBATCH blocks at a time, with the
+// header and its checksum in the last batch.
+// This is the true point at which the transaction commits.
+static void
+write_log(struct buf **bs)
+{
+  struct buf *to[LOGBATCH+1];
+  struct logheader *hb;
+  int tail, i, n;
+
+  log.clh.sum = headsum(&log.clh);
+  for (i = 0; i < log.clh.n; i++)
+    log.clh.sum = fnv(log.clh.sum, bs[i]->data, BSIZE);
+
+  for (tail = 0; tail < log.clh.n; tail += n) {
+    n = log.clh.n - tail;
+    if(n > LOGBATCH)
+      n = LOGBATCH;
+    for (i = 0; i < n; i++) {
+      // no need to read a log block we overwrite.
+      to[i] = bgetnew(log.dev, log.start+tail+1+i);
+      memmove(to[i]->data, bs[tail+i]->data, BSIZE);
+    }
+    if(tail + n == log.clh.n){
+      to[n] = bgetnew(log.dev, log.start);
+      hb = (struct logheader *) (to[n]->data);
+      *hb = log.clh;
+      n++;
+    }
+    bwritev(to, n);  // write the log
+    for (i = 0; i < n; i++)
+      brelse(to[i]);
   }
 }
 
-// Copy modified blocks from cache to log.
+// Write the blocks in bs to their home locations,
+// LOGBATCH blocks at a time, and unlock and unpin them.
 static void
-write_log(void)
+install_blocks(struct buf **bs)
 {
-  int tail;
+  int tail, i, n;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
+  for (tail = 0; tail < log.clh.n; tail += n) {
+    n = log.clh.n - tail;
+    if(n > LOGBATCH)
+      n = LOGBATCH;
+    bwritev(&bs[tail], n);
+    for (i = 0; i < n; i++) {
+      bunpin(bs[tail+i]);
+      brelse(bs[tail+i]);
+    }
   }
 }
 
 static void
-commit()
+commit(struct buf **bs)
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(0); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+  write_log(bs);        // Write blocks and header to log -- the real commit
+  install_blocks(bs);   // Now install writes to home locations
+  log.clh.n = 0;
+}
+
+// The commit thread. Commits the transactions end_op()
+// hands it, one at a time.
+static void
+logthread(void)
+{
+  struct buf *bs[LOGBLOCKS];
+  struct logheader empty;
+  int i, cleared = 1;
+
+  empty.n = 0;
+  empty.sum = 0;
+  acquire(&log.lock);
+  while(1){
+    while(!log.committing){
+      if(!cleared){
+        // idle: erase the last transaction from the log,
+        // so that recovery won't install it again.
+        release(&log.lock);
+        write_head(&empty);
+        cleared = 1;
+        acquire(&log.lock);
+        continue;
+      }
+      sleep(&log.clh, &log.lock);
+    }
+    cleared = 0;
+    release(&log.lock);
+
+    // nobody is in the transaction any more, and nobody
+    // can start the next one until the blocks are locked.
+    for (i = 0; i < log.clh.n; i++)
+      bs[i] = bread(log.dev, log.clh.block[i]);
+    acquire(&log.lock);
+    log.closing = 0;
+    wakeup(&log);
+    release(&log.lock);
+
+    commit(bs);
+
+    acquire(&log.lock);
+    log.committing = 0;
+    log.done++;
+    if(log.lh.n > 0){
+      // the next transaction has been waiting for us;
+      // commit it as soon as its sys calls are done.
+      if(log.outstanding == 0)
+        handoff();
+      else
+        log.closing = 1;
+    }
+    wakeup(&log);
   }
 }
 
+// Wait until the transactions of FS sys calls that have
+// finished are committed and installed. The current
+// transaction, if it has any blocks, is handed off once
+// its sys calls end, so callers must not be inside one.
+void
+log_sync(void)
+{
+  uint want;
+
+  acquire(&log.lock);
+  want = log.handed + (log.lh.n > 0);
+  while((int)(log.done - want) < 0)
+    sleep(&log, &log.lock);
+  release(&log.lock);
+}
+
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache by increasing refcnt.
-// commit()/write_log() will do the disk write.
+// logthread() will do the disk write.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
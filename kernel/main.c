@@ -25,8 +25,12 @@ main()
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
+    pcacheinit();    // page cache
+    ioschedinit();   // I/O scheduler
     iinit();         // inode table
     fileinit();      // file table
+    futexinit();     // futex wait queues
+    shminit();       // shared memory segments
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
@@ -17,6 +17,9 @@
 // end -- start of kernel page allocation area
 // PHYSTOP -- end RAM used by the kernel
 
+// qemu's virt machine's time CSR counts at 10 MHz.
+#define TIMEFREQ 10000000L
+
 // qemu puts UART registers here in physical memory.
 #define UART0 0x10000000L
 #define UART0_IRQ 10
@@ -54,6 +57,13 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   SHMBASE (shared memory segments, see shm.c)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+
+// each shared memory segment id has a fixed slot of
+// SHMPAGES pages beneath the trapframe. the heap
+// must stay below SHMBASE.
+#define SHMVA(id) (TRAPFRAME - ((id)+1)*SHMPAGES*PGSIZE)
+#define SHMBASE SHMVA(NSHM-1)
@@ -1,8 +1,4 @@
-#ifdef LAB_FS
-#define NPROC        10  // maximum number of processes
-#else
-#define NPROC        64  // maximum number of processes (speedsup bigfile)
-#endif
+#define PROCPAGES    64  // free pages per allowed process (sizes proc table)
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
@@ -12,7 +8,9 @@
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGBLOCKS    (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define LOGBATCH     8  // log blocks written to disk at once
+#define NBUF         (2*LOGBLOCKS+LOGBATCH)  // minimum size of disk block cache
+#define NREADAHEAD   32  // max blocks of sequential read-ahead
 #ifdef LAB_FS
 #define FSSIZE       200000  // size of file system in blocks
 #else
@@ -23,6 +21,8 @@
 #endif
 #endif
 #define MAXPATH      128   // maximum file path name
+#define NSHM         16    // maximum number of shared memory segments
+#define SHMPAGES     16    // maximum pages per shared memory segment
 
 #ifdef LAB_UTIL
 #define USERSTACK    2     // user stack pages
@@ -0,0 +1,232 @@
+//
+// Page cache.
+//
+// The contents of regular files are cached in 4096-byte pages,
+// kept per inode in a radix tree indexed by page number (file
+// offset / PGSIZE). readi() copies file data out of the page
+// cache, reading a page's blocks in through the buffer cache
+// when the page isn't cached. The buffer cache then forgets
+// them (bforget()), so a block of file data is cached once, in
+// its page, and not in a buf as well. writei() still writes
+// through the buffer cache and the log, and updates any cached
+// page as well. Directories and other metadata live only in
+// the buffer cache.
+//
+// A tree node is a page of RADIXFAN pointers, to child nodes or,
+// at the bottom, to cached pages. A tree of height h holds pages
+// 0 .. RADIXFAN^h - 1.
+//
+// pcache.lock protects every tree. It is never held while
+// allocating memory, since kalloc() may call pcshrink() to get
+// pages back. An inode's pages stay cached while the inode is in
+// the inode table, and are freed when the inode is truncated, its
+// table entry is recycled, or memory runs short and nobody is
+// using the inode.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "file.h"
+
+#define RADIXBITS 9
+#define RADIXFAN  (1 << RADIXBITS)   // pointers in a node page
+#define BPERPG    (PGSIZE / BSIZE)   // blocks per page
+
+struct {
+  struct spinlock lock;
+  int npages;        // cached pages, for debugging
+} pcache;
+
+void
+pcacheinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+}
+
+// Return the address of the slot for page pn in ip's tree.
+// If alloc, add nodes as needed, using *spare; if that is 0,
+// return 0 so that the caller can allocate a node and retry.
+// If !alloc, return 0 if page pn has no slot.
+// pcache.lock must be held.
+static void**
+pcslot(struct inode *ip, uint pn, int alloc, void **spare)
+{
+  void **node;
+  int level;
+
+  // grow the tree until it is high enough to hold pn.
+  while(ip->pcroot == 0 || (pn >> (RADIXBITS * ip->pcheight)) != 0){
+    if(!alloc || *spare == 0)
+      return 0;
+    node = (void **)*spare;
+    *spare = 0;
+    memset(node, 0, PGSIZE);
+    node[0] = ip->pcroot;
+    ip->pcroot = node;
+    ip->pcheight++;
+  }
+
+  node = ip->pcroot;
+  for(level = ip->pcheight - 1; level > 0; level--){
+    void **slot = &node[(pn >> (RADIXBITS * level)) & (RADIXFAN - 1)];
+    if(*slot == 0){
+      if(!alloc || *spare == 0)
+        return 0;
+      *slot = *spare;
+      *spare = 0;
+      memset(*slot, 0, PGSIZE);
+    }
+    node = (void **)*slot;
+  }
+  return &node[pn & (RADIXFAN - 1)];
+}
+
+// Read page pn of ip's content into pa, through the buffer cache.
+// Caller must hold ip->lock, perhaps shared.
+static void
+pcfill(struct inode *ip, uint pn, char *pa)
+{
+  struct buf *bp;
+  uint bn, addr, nb;
+  int i;
+
+  bn = pn * BPERPG;
+  nb = 0;
+  while(nb < BPERPG && (bn + nb) * BSIZE < ip->size)
+    nb++;
+
+  // start all the reads, then wait for them one by one.
+  ireadahead(ip, bn, nb);
+  for(i = 0; i < BPERPG; i++){
+    if(i >= nb || (addr = bmap(ip, bn + i)) == 0){
+      memset(pa + i*BSIZE, 0, BSIZE);
+      continue;
+    }
+    bp = bread(ip->dev, addr);
+    memmove(pa + i*BSIZE, bp->data, BSIZE);
+    bforget(bp);  // the page has it now
+  }
+}
+
+// Is page pn of ip cached?
+int
+pccached(struct inode *ip, uint pn)
+{
+  void **slot;
+  int r;
+
+  acquire(&pcache.lock);
+  slot = pcslot(ip, pn, 0, 0);
+  r = slot && *slot;
+  release(&pcache.lock);
+  return r;
+}
+
+// Return the cached page holding page pn of regular file ip,
+// reading it in if it isn't cached.
+// Returns 0 if out of memory.
+// Caller must hold ip->lock, perhaps shared.
+char*
+pcpage(struct inode *ip, uint pn)
+{
+  void **slot, *spare = 0;
+  char *pa, *cached;
+
+  acquire(&pcache.lock);
+  slot = pcslot(ip, pn, 0, 0);
+  cached = slot ? *slot : 0;
+  release(&pcache.lock);
+  if(cached)
+    return cached;
+
+  if((pa = kalloc()) == 0)
+    return 0;
+  pcfill(ip, pn, pa);
+
+  // another reader holding ip->lock shared may have
+  // added the page meanwhile.
+  acquire(&pcache.lock);
+  while((slot = pcslot(ip, pn, 1, &spare)) == 0){
+    release(&pcache.lock);
+    if((spare = kalloc()) == 0){
+      kfree(pa);
+      return 0;
+    }
+    acquire(&pcache.lock);
+  }
+  if(*slot){
+    cached = *slot;
+  } else {
+    *slot = cached = pa;
+    pa = 0;
+    pcache.npages++;
+  }
+  release(&pcache.lock);
+
+  if(pa)
+    kfree(pa);
+  if(spare)
+    kfree(spare);
+  return cached;
+}
+
+// writei() has just written n bytes at off in ip, copying them
+// from src; update the cached copy, if any.
+// Caller must hold ip->lock exclusively.
+void
+pcwrite(struct inode *ip, uint off, char *src, uint n)
+{
+  void **slot;
+  char *pa;
+
+  acquire(&pcache.lock);
+  slot = pcslot(ip, off / PGSIZE, 0, 0);
+  pa = slot ? *slot : 0;
+  release(&pcache.lock);
+
+  // only writers, who hold ip->lock exclusively, change the
+  // page, so it's safe to copy without pcache.lock.
+  if(pa)
+    memmove(pa + off % PGSIZE, src, n);
+}
+
+// Free a subtree of height h.
+static void
+pcfree(void **node, int h)
+{
+  for(int i = 0; i < RADIXFAN; i++){
+    if(node[i] == 0)
+      continue;
+    if(h > 1)
+      pcfree((void **)node[i], h - 1);
+    else
+      pcache.npages--;
+    kfree(node[i]);
+  }
+}
+
+// Drop all of ip's cached pages.
+// Caller must hold ip->lock exclusively, or know that
+// nobody is using ip.
+void
+pcdrop(struct inode *ip)
+{
+  void **root;
+
+  acquire(&pcache.lock);
+  root = ip->pcroot;
+  if(root){
+    pcfree(root, ip->pcheight);
+    ip->pcroot = 0;
+    ip->pcheight = 0;
+  }
+  release(&pcache.lock);
+  if(root)
+    kfree(root);
+}
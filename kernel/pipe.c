@@ -68,6 +68,7 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
+    freelock(&pi->lock);
     kfree((char*)pi);
   } else
     release(&pi->lock);
@@ -102,6 +103,13 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
   return i;
 }
 
+// Copy out the statistics of pi's lock; see lockstat.h.
+int
+pipelockstat(struct pipe *pi, uint64 addr)
+{
+  return lockstat_lock(&pi->lock, addr);
+}
+
 int
 piperead(struct pipe *pi, uint64 addr, int n)
 {
@@ -4,17 +4,35 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "rusage.h"
+#include "wait.h"
 #include "defs.h"
 
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
+// Every struct proc ever allocated, linked through p->allnext.
+// Procs are carved out of kalloc()ed pages as needed and are
+// never given back, only put on freeprocs, so this list only
+// grows at its head and can be walked without a lock.
+struct proc *allproc;
 
 struct proc *initproc;
 
+// pid_lock protects nextpid, the pid hash, the free list,
+// and the counts below.
 int nextpid = 1;
 struct spinlock pid_lock;
 
+#define NPIDHASH 64
+static struct proc *pidhash[NPIDHASH]; // in-use procs, via p->hashnext
+static struct proc *freeprocs;         // UNUSED procs, via p->hashnext
+static int nproc;                      // procs in use
+static int maxproc;                    // limit on nproc
+static int nkstack;                    // kernel stack slots handed out
+
+// mask of CPUs that have entered scheduler().
+int cpusonline;
+
 extern void forkret(void);
 static void freeproc(struct proc *p);
 
@@ -26,36 +44,67 @@ extern char trampoline[]; // trampoline.S
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
+// initialize the proc table.
+// the number of processes is limited only by memory:
+// allow one for every PROCPAGES free pages.
 void
-proc_mapstacks(pagetable_t kpgtbl)
+procinit(void)
 {
-  struct proc *p;
-  
-  for(p = proc; p < &proc[NPROC]; p++) {
-    char *pa = kalloc();
-    if(pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int) (p - proc));
-    kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
+  initlock(&pid_lock, "nextpid");
+  initlock(&wait_lock, "wait_lock");
+  maxproc = kfreepages() / PROCPAGES;
+}
+
+// Carve a fresh page into struct procs and put them
+// on the free list.
+// Caller must hold pid_lock.
+static int
+growprocs(void)
+{
+  struct proc *p, *pa;
+
+  if((pa = kalloc()) == 0)
+    return -1;
+  memset(pa, 0, PGSIZE);
+  for(p = pa; p + 1 <= (struct proc *)((char *)pa + PGSIZE); p++){
+    initlock(&p->lock, "proc");
+    p->state = UNUSED;
+    p->hashnext = freeprocs;
+    freeprocs = p;
+    p->allnext = allproc;
+    // make sure scheduler() and wakeup() see an initialized proc.
+    __sync_synchronize();
+    allproc = p;
   }
+  return 0;
 }
 
-// initialize the proc table.
-void
-procinit(void)
+// Find the in-use proc with the given pid.
+// Returns it with p->lock held, or 0.
+static struct proc*
+findproc(int pid)
 {
   struct proc *p;
-  
-  initlock(&pid_lock, "nextpid");
-  initlock(&wait_lock, "wait_lock");
-  for(p = proc; p < &proc[NPROC]; p++) {
-      initlock(&p->lock, "proc");
-      p->state = UNUSED;
-      p->kstack = KSTACK((int) (p - proc));
+
+  if(pid <= 0)
+    return 0;
+
+  acquire(&pid_lock);
+  for(p = pidhash[pid % NPIDHASH]; p; p = p->hashnext)
+    if(p->pid == pid)
+      break;
+  release(&pid_lock);
+  if(p == 0)
+    return 0;
+
+  // p can't be freed out from under us, but it
+  // may have exited and been reused since.
+  acquire(&p->lock);
+  if(p->pid != pid || p->state == UNUSED){
+    release(&p->lock);
+    return 0;
   }
+  return p;
 }
 
 // Must be called with interrupts disabled,
@@ -89,41 +138,47 @@ myproc(void)
   return p;
 }
 
-int
-allocpid()
-{
-  int pid;
-  
-  acquire(&pid_lock);
-  pid = nextpid;
-  nextpid = nextpid + 1;
-  release(&pid_lock);
-
-  return pid;
-}
-
-// Look in the process table for an UNUSED proc.
+// Take an UNUSED proc off the free list, growing the table
+// if needed, and give it a pid and a kernel stack.
+// The stack is mapped in the kernel page table the first time
+// a proc is used, beneath the trampoline and above an invalid
+// guard page, and stays mapped for later reuse of the proc.
 // If found, initialize state required to run in the kernel,
 // and return with p->lock held.
-// If there are no free procs, or a memory allocation fails, return 0.
+// If there are too many procs, or a memory allocation fails, return 0.
 static struct proc*
 allocproc(void)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    } else {
-      release(&p->lock);
+  acquire(&pid_lock);
+  if(nproc >= maxproc || (freeprocs == 0 && growprocs() < 0)){
+    release(&pid_lock);
+    return 0;
+  }
+  p = freeprocs;
+  if(p->kstack == 0){
+    if(kvmalloc(KSTACK(nkstack)) < 0){
+      release(&pid_lock);
+      return 0;
     }
+    p->kstack = KSTACK(nkstack);
+    nkstack++;
   }
-  return 0;
+  freeprocs = p->hashnext;
+  nproc++;
+  p->pid = nextpid++;
+  p->hashnext = pidhash[p->pid % NPIDHASH];
+  pidhash[p->pid % NPIDHASH] = p;
+  release(&pid_lock);
 
-found:
-  p->pid = allocpid();
+  acquire(&p->lock);
   p->state = USED;
+  p->affinity = ALLCPUS;
+  p->lastcpu = -1;
+  p->migrations = 0;
+  memset(&p->usage, 0, sizeof(p->usage));
+  memset(&p->cusage, 0, sizeof(p->cusage));
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -162,13 +217,29 @@ freeproc(struct proc *p)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
   p->sz = 0;
-  p->pid = 0;
   p->parent = 0;
+  p->children = 0;
+  p->sibling = 0;
+  p->zombies = 0;
+  p->nextzombie = 0;
   p->name[0] = 0;
+  p->kthread = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
   p->state = UNUSED;
+
+  // unhash and put on the free list.
+  acquire(&pid_lock);
+  struct proc **pp;
+  for(pp = &pidhash[p->pid % NPIDHASH]; *pp != p; pp = &(*pp)->hashnext)
+    ;
+  *pp = p->hashnext;
+  p->hashnext = freeprocs;
+  freeprocs = p;
+  nproc--;
+  p->pid = 0;
+  release(&pid_lock);
 }
 
 // Create a user page table for a given process, with no user memory,
@@ -212,6 +283,7 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  shmunmapall(pagetable);
   uvmfree(pagetable, sz);
 }
 
@@ -231,6 +303,42 @@ userinit(void)
   release(&p->lock);
 }
 
+// A kernel thread's very first scheduling by scheduler()
+// will swtch to kthreadret.
+static void
+kthreadret(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler, which
+  // turned interrupts off.
+  release(&p->lock);
+  intr_on();
+
+  p->kthread();
+  panic("kthread returned");
+}
+
+// Start a kernel thread: a process with no user memory
+// that runs fn(), which must not return, in the kernel.
+// Returns its pid, or -1.
+int
+kthread(void (*fn)(void), char *name)
+{
+  struct proc *p;
+  int pid;
+
+  if((p = allocproc()) == 0)
+    return -1;
+  p->kthread = fn;
+  p->context.ra = (uint64)kthreadret;
+  safestrcpy(p->name, name, sizeof(p->name));
+  pid = p->pid;
+  p->state = RUNNABLE;
+  release(&p->lock);
+  return pid;
+}
+
 // Shrink user memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
@@ -241,6 +349,8 @@ growproc(int n)
 
   sz = p->sz;
   if(n > 0){
+    if(sz + n > SHMBASE)
+      return -1;
     if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
       return -1;
     }
@@ -273,6 +383,13 @@ kfork(void)
   }
   np->sz = p->sz;
 
+  // Share the parent's shared memory segments.
+  if(shmcopy(p->pagetable, np->pagetable) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
 
@@ -287,12 +404,16 @@ kfork(void)
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
+  np->affinity = p->affinity;
+
   pid = np->pid;
 
   release(&np->lock);
 
   acquire(&wait_lock);
   np->parent = p;
+  np->sibling = p->children;
+  p->children = np;
   release(&wait_lock);
 
   acquire(&np->lock);
@@ -302,19 +423,65 @@ kfork(void)
   return pid;
 }
 
-// Pass p's abandoned children to init.
+// Add the counters in b to a.
+static void
+addusage(struct usage *a, struct usage *b)
+{
+  a->utime += b->utime;
+  a->stime += b->stime;
+  a->nvcsw += b->nvcsw;
+  a->nivcsw += b->nivcsw;
+  a->pgfaults += b->pgfaults;
+  a->inblock += b->inblock;
+  a->oublock += b->oublock;
+}
+
+// Pass p's abandoned children, and its queue of unreaped
+// zombies, to init.
 // Caller must hold wait_lock.
 void
 reparent(struct proc *p)
 {
   struct proc *pp;
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p){
-      pp->parent = initproc;
-      wakeup(initproc);
+  if(p->children == 0)
+    return;
+
+  for(pp = p->children; ; pp = pp->sibling){
+    pp->parent = initproc;
+    if(pp->sibling == 0)
+      break;
+  }
+  pp->sibling = initproc->children;
+  initproc->children = p->children;
+  p->children = 0;
+
+  if(p->zombies){
+    for(pp = p->zombies; pp->nextzombie; pp = pp->nextzombie)
+      ;
+    pp->nextzombie = initproc->zombies;
+    initproc->zombies = p->zombies;
+    p->zombies = 0;
+  }
+
+  wakeup(initproc);
+}
+
+// Remove child pp from its parent's list of children.
+// Caller must hold wait_lock.
+static void
+unlinkchild(struct proc *pp)
+{
+  struct proc **cp;
+
+  for(cp = &pp->parent->children; *cp; cp = &(*cp)->sibling){
+    if(*cp == pp){
+      *cp = pp->sibling;
+      pp->sibling = 0;
+      return;
     }
   }
+  panic("unlinkchild");
 }
 
 // Exit the current process.  Does not return.
@@ -347,7 +514,9 @@ kexit(int status)
   // Give any children to init.
   reparent(p);
 
-  // Parent might be sleeping in wait().
+  // Queue for the parent's wait(), which might be sleeping.
+  p->nextzombie = p->parent->zombies;
+  p->parent->zombies = p;
   wakeup(p->parent);
   
   acquire(&p->lock);
@@ -362,49 +531,60 @@ kexit(int status)
   panic("zombie exit");
 }
 
-// Wait for a child process to exit and return its pid.
-// Return -1 if this process has no children.
+// Wait for the child with the given pid (or any child, if
+// pid is -1) to exit and return its pid.
+// Return -1 if this process has no such child, or 0 if
+// options has WNOHANG and no such child has exited yet.
 int
-kwait(uint64 addr)
+kwait(int pid, uint64 addr, int options)
 {
-  struct proc *pp;
-  int havekids, pid;
+  struct proc *pp, **zp;
+  int havekids;
   struct proc *p = myproc();
 
   acquire(&wait_lock);
 
   for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(pp = proc; pp < &proc[NPROC]; pp++){
-      if(pp->parent == p){
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&pp->lock);
+    // Look for an exited child in the zombie queue.
+    for(zp = &p->zombies; *zp; zp = &(*zp)->nextzombie)
+      if(pid == -1 || (*zp)->pid == pid)
+        break;
 
-        havekids = 1;
-        if(pp->state == ZOMBIE){
-          // Found one.
-          pid = pp->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
-                                  sizeof(pp->xstate)) < 0) {
-            release(&pp->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(pp);
-          release(&pp->lock);
-          release(&wait_lock);
-          return pid;
-        }
+    if((pp = *zp) != 0){
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&pp->lock);
+
+      if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
+                              sizeof(pp->xstate)) < 0) {
         release(&pp->lock);
+        release(&wait_lock);
+        return -1;
       }
+      *zp = pp->nextzombie;
+      unlinkchild(pp);
+      addusage(&p->cusage, &pp->usage);
+      addusage(&p->cusage, &pp->cusage);
+      pid = pp->pid;
+      freeproc(pp);
+      release(&pp->lock);
+      release(&wait_lock);
+      return pid;
     }
 
-    // No point waiting if we don't have any children.
+    havekids = 0;
+    for(pp = p->children; pp; pp = pp->sibling)
+      if(pid == -1 || pp->pid == pid)
+        havekids = 1;
+
+    // No point waiting if we don't have any such children.
     if(!havekids || killed(p)){
       release(&wait_lock);
       return -1;
     }
+    if(options & WNOHANG){
+      release(&wait_lock);
+      return 0;
+    }
     
     // Wait for a child to exit.
     sleep(p, &wait_lock);  //DOC: wait-sleep
@@ -418,11 +598,21 @@ kwait(uint64 addr)
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
+//
+// A process may only run on the CPUs in its affinity mask.
+// To keep caches and TLBs warm, a CPU first looks only for
+// processes that last ran on it (or never ran); it takes a
+// process from another CPU only after a pass that found
+// nothing of its own.
 void
 scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = cpuid();
+  int steal = 0;
+
+  __sync_fetch_and_or(&cpusonline, 1 << id);
 
   c->proc = 0;
   for(;;){
@@ -435,14 +625,21 @@ scheduler(void)
     intr_off();
 
     int found = 0;
-    for(p = proc; p < &proc[NPROC]; p++) {
+    for(p = allproc; p; p = p->allnext) {
       acquire(&p->lock);
-      if(p->state == RUNNABLE) {
+      if(p->state == RUNNABLE && (p->affinity & (1 << id)) &&
+         (steal || p->lastcpu == id || p->lastcpu < 0)) {
+        if(p->lastcpu >= 0 && p->lastcpu != id)
+          p->migrations++;
+        p->lastcpu = id;
+
         // Switch to chosen process.  It is the process's job
         // to release its lock and then reacquire it
         // before jumping back to us.
         p->state = RUNNING;
+        p->tstamp = r_time();
         c->proc = p;
+        kvmsync();
         swtch(&c->context, &p->context);
 
         // Process is done running for now.
@@ -452,8 +649,14 @@ scheduler(void)
       }
       release(&p->lock);
     }
-    if(found == 0) {
+    if(found){
+      steal = 0;
+    } else if(!steal){
+      // nothing of our own; look at other CPUs' processes.
+      steal = 1;
+    } else {
       // nothing to run; stop running on this core until an interrupt.
+      steal = 0;
       asm volatile("wfi");
     }
   }
@@ -481,6 +684,8 @@ sched(void)
   if(intr_get())
     panic("sched interruptible");
 
+  p->usage.stime += r_time() - p->tstamp;
+
   intena = mycpu()->intena;
   swtch(&p->context, &mycpu()->context);
   mycpu()->intena = intena;
@@ -493,6 +698,7 @@ yield(void)
   struct proc *p = myproc();
   acquire(&p->lock);
   p->state = RUNNABLE;
+  p->usage.nivcsw++;
   sched();
   release(&p->lock);
 }
@@ -554,6 +760,7 @@ sleep(void *chan, struct spinlock *lk)
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->usage.nvcsw++;
 
   sched();
 
@@ -572,7 +779,7 @@ wakeup(void *chan)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
+  for(p = allproc; p; p = p->allnext) {
     if(p != myproc()){
       acquire(&p->lock);
       if(p->state == SLEEPING && p->chan == chan) {
@@ -583,28 +790,129 @@ wakeup(void *chan)
   }
 }
 
-// Kill the process with the given pid.
-// The victim won't exit until it tries to return
-// to user space (see usertrap() in trap.c).
+// Wake up at most n processes sleeping on channel chan.
+// Returns the number of processes woken.
+// Caller should hold the condition lock.
 int
-kkill(int pid)
+wakeupn(void *chan, int n)
 {
   struct proc *p;
+  int woken = 0;
 
-  for(p = proc; p < &proc[NPROC]; p++){
-    acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
+  for(p = allproc; p && woken < n; p = p->allnext) {
+    if(p != myproc()){
+      acquire(&p->lock);
+      if(p->state == SLEEPING && p->chan == chan) {
         p->state = RUNNABLE;
+        woken++;
       }
       release(&p->lock);
-      return 0;
     }
-    release(&p->lock);
   }
-  return -1;
+  return woken;
+}
+
+// Kill the process with the given pid.
+// The victim won't exit until it tries to return
+// to user space (see usertrap() in trap.c).
+int
+kkill(int pid)
+{
+  struct proc *p;
+
+  if((p = findproc(pid)) == 0)
+    return -1;
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    // Wake process from sleep().
+    p->state = RUNNABLE;
+  }
+  release(&p->lock);
+  return 0;
+}
+
+// Restrict the process with the given pid (or the current
+// process, if pid is 0) to the CPUs in mask.
+// Returns 0, or -1 if there is no such process or mask
+// contains no running CPU.
+int
+setaffinity(int pid, int mask)
+{
+  struct proc *p;
+  struct proc *me = myproc();
+
+  mask &= ALLCPUS;
+  if((mask & cpusonline) == 0)
+    return -1;
+  if(pid == 0)
+    pid = me->pid;
+
+  if((p = findproc(pid)) == 0)
+    return -1;
+  p->affinity = mask;
+  release(&p->lock);
+
+  // move off this CPU if it's no longer allowed.
+  if(p == me){
+    push_off();
+    int id = cpuid();
+    pop_off();
+    if((mask & (1 << id)) == 0)
+      yield();
+  }
+  return 0;
+}
+
+// Return the affinity mask of the process with the given pid
+// (or of the current process, if pid is 0), or -1.
+int
+getaffinity(int pid)
+{
+  struct proc *p;
+  int mask;
+
+  if(pid == 0)
+    pid = myproc()->pid;
+
+  if((p = findproc(pid)) == 0)
+    return -1;
+  mask = p->affinity;
+  release(&p->lock);
+  return mask;
+}
+
+// Copy the resource usage of the current process (who ==
+// RUSAGE_SELF), of its waited-for children (RUSAGE_CHILDREN),
+// or of the process with pid who into u.
+// Returns 0, or -1 if there is no such process.
+int
+getusage(int who, struct usage *u)
+{
+  struct proc *p;
+  struct proc *me = myproc();
+
+  if(who == RUSAGE_SELF || who == me->pid){
+    acquire(&me->lock);
+    // charge the time since the last trap.
+    uint64 now = r_time();
+    me->usage.stime += now - me->tstamp;
+    me->tstamp = now;
+    *u = me->usage;
+    release(&me->lock);
+    return 0;
+  }
+  if(who == RUSAGE_CHILDREN){
+    acquire(&wait_lock);
+    *u = me->cusage;
+    release(&wait_lock);
+    return 0;
+  }
+
+  if((p = findproc(who)) == 0)
+    return -1;
+  *u = p->usage;
+  release(&p->lock);
+  return 0;
 }
 
 void
@@ -674,14 +982,15 @@ procdump(void)
   char *state;
 
   printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
+  for(p = allproc; p; p = p->allnext){
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
       state = states[p->state];
     else
       state = "???";
-    printf("%d %s %s", p->pid, state, p->name);
+    printf("%d %s %s cpu %d migrations %d", p->pid, state, p->name,
+           p->lastcpu, p->migrations);
     printf("\n");
   }
 }
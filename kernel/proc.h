@@ -24,10 +24,13 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  uint kvmgen;                // kvmgen as of this CPU's last TLB flush
 };
 
 extern struct cpu cpus[NCPU];
 
+#define ALLCPUS ((1 << NCPU) - 1)
+
 // per-process data for the trap handling code in trampoline.S.
 // sits in a page by itself just under the trampoline page in the
 // user page table. not specially mapped in the kernel page table.
@@ -81,19 +84,45 @@ struct trapframe {
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// Per-process resource counters, reported by getrusage().
+// Times are in time CSR ticks.
+struct usage {
+  uint64 utime;
+  uint64 stime;
+  uint64 nvcsw;
+  uint64 nivcsw;
+  uint64 pgfaults;
+  uint64 inblock;
+  uint64 oublock;
+};
+
 // Per-process state
 struct proc {
   struct spinlock lock;
 
+  // pid_lock must be held when using this:
+  struct proc *hashnext;       // Next in pid hash chain or free list
+
+  // set once when the proc is created:
+  struct proc *allnext;        // Next in list of all procs
+
   // p->lock must be held when using these:
   enum procstate state;        // Process state
   void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int affinity;                // Mask of CPUs it may run on
+  int lastcpu;                 // CPU it last ran on, or -1
+  int migrations;              // Times it was run on a different CPU
 
   // wait_lock must be held when using this:
   struct proc *parent;         // Parent process
+  struct proc *children;       // First child; rest linked via sibling
+  struct proc *sibling;        // Next child of the same parent
+  struct proc *zombies;        // Exited children not yet waited for
+  struct proc *nextzombie;     // Next in parent's zombies
+  struct usage cusage;         // Totals of waited-for children
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
@@ -104,4 +133,7 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  void (*kthread)(void);       // Body of a kernel thread, else 0
+  struct usage usage;          // Resources used so far
+  uint64 tstamp;               // time CSR when utime/stime last charged
 };
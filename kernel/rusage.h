@@ -0,0 +1,16 @@
+// Resource usage of a process, as returned by getrusage().
+// Both the kernel and user programs use this header file.
+
+#define RUSAGE_SELF      0   // the calling process
+#define RUSAGE_CHILDREN -1   // all of its waited-for descendants
+                             // any other who is a pid
+
+struct rusage {
+  uint64 utime;     // user CPU time (microseconds)
+  uint64 stime;     // system CPU time (microseconds)
+  uint64 nvcsw;     // voluntary context switches (sleeps)
+  uint64 nivcsw;    // involuntary context switches (preemptions)
+  uint64 pgfaults;  // page faults handled
+  uint64 inblock;   // blocks read from disk
+  uint64 oublock;   // blocks written to disk
+};
@@ -0,0 +1,244 @@
+//
+// Shared memory segments.
+//
+// A segment is a set of physical pages that several processes
+// map into their page tables. Segment id i is always mapped at
+// SHMVA(i), just below the trapframe, so the same segment has
+// the same address in every process that attaches it and
+// pointers into it can be shared.
+//
+// A process's page table is the record of which segments it has
+// attached: a segment is attached iff SHMVA(id) is mapped. Each
+// attachment holds a reference on the segment.
+//
+// A segment outlives the processes that use it until someone
+// calls shmrm(), like System V's IPC_RMID: it then loses its key
+// and can't be attached again, and its pages are freed once the
+// last attached process detaches, exits, or execs, or at once if
+// none is attached. So a creator that exits before anyone
+// attaches doesn't lose the segment, and one that is never
+// attached isn't stranded: shmrm() frees it.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "proc.h"
+
+struct shm {
+  int used;       // slot holds a segment
+  int removed;    // shmrm() called; free when ref drops to 0
+  int key;        // shmget() key; 0 for a private segment
+  int ref;        // number of attached page tables
+  int npages;
+  char *pages[SHMPAGES];
+};
+
+struct {
+  struct spinlock lock;
+  struct shm shm[NSHM];
+} shmtab;
+
+void
+shminit(void)
+{
+  initlock(&shmtab.lock, "shm");
+}
+
+// free a segment's pages and its slot.
+// shmtab.lock must be held.
+static void
+shmfree(struct shm *sh)
+{
+  for(int i = 0; i < sh->npages; i++){
+    if(sh->pages[i])
+      kfree(sh->pages[i]);
+    sh->pages[i] = 0;
+  }
+  sh->npages = 0;
+  sh->key = 0;
+  sh->ref = 0;
+  sh->removed = 0;
+  sh->used = 0;
+}
+
+// Drop one attachment's reference on segment id.
+static void
+shmput(int id)
+{
+  struct shm *sh = &shmtab.shm[id];
+
+  acquire(&shmtab.lock);
+  if(sh->ref < 1)
+    panic("shmput");
+  if(--sh->ref == 0 && sh->removed)
+    shmfree(sh);
+  release(&shmtab.lock);
+}
+
+// Return the id of the segment with the given key, creating
+// it with room for size bytes if no such segment exists.
+// Key 0 always creates a new, private segment.
+// Returns -1 if size is bad or no slots or memory are left.
+int
+shmget(int key, int size)
+{
+  struct shm *sh, *empty = 0;
+  int npages = PGROUNDUP((uint64)size) / PGSIZE;
+
+  if(size <= 0 || npages > SHMPAGES)
+    return -1;
+
+  acquire(&shmtab.lock);
+  for(sh = shmtab.shm; sh < &shmtab.shm[NSHM]; sh++){
+    if(sh->used && key != 0 && sh->key == key){
+      if(npages > sh->npages){
+        release(&shmtab.lock);
+        return -1;
+      }
+      release(&shmtab.lock);
+      return sh - shmtab.shm;
+    }
+    if(!sh->used && empty == 0)
+      empty = sh;
+  }
+  if((sh = empty) == 0){
+    release(&shmtab.lock);
+    return -1;
+  }
+
+  sh->used = 1;
+  sh->removed = 0;
+  sh->key = key;
+  sh->ref = 0;
+  for(sh->npages = 0; sh->npages < npages; sh->npages++){
+    char *mem = kalloc();
+    if(mem == 0){
+      shmfree(sh);
+      release(&shmtab.lock);
+      return -1;
+    }
+    memset(mem, 0, PGSIZE);
+    sh->pages[sh->npages] = mem;
+  }
+  release(&shmtab.lock);
+  return sh - shmtab.shm;
+}
+
+// Map segment id's pages at SHMVA(id) in pagetable.
+// shmtab.lock must be held.
+static int
+shmmap(pagetable_t pagetable, int id)
+{
+  struct shm *sh = &shmtab.shm[id];
+
+  for(int i = 0; i < sh->npages; i++){
+    if(mappages(pagetable, SHMVA(id) + i*PGSIZE, PGSIZE,
+                (uint64)sh->pages[i], PTE_R|PTE_W|PTE_U) != 0){
+      uvmunmap(pagetable, SHMVA(id), i, 0);
+      return -1;
+    }
+  }
+  sh->ref++;
+  return 0;
+}
+
+// Attach segment id to the current process.
+// Returns the address it is mapped at, or -1.
+uint64
+shmat(int id)
+{
+  struct proc *p = myproc();
+
+  if(id < 0 || id >= NSHM)
+    return -1;
+  if(SHMVA(id) < p->sz || ismapped(p->pagetable, SHMVA(id)))
+    return -1;
+
+  acquire(&shmtab.lock);
+  if(!shmtab.shm[id].used || shmtab.shm[id].removed ||
+     shmmap(p->pagetable, id) < 0){
+    release(&shmtab.lock);
+    return -1;
+  }
+  release(&shmtab.lock);
+  return SHMVA(id);
+}
+
+// Detach the segment attached at addr from the current process.
+// Returns 0, or -1 if nothing is attached there.
+int
+shmdt(uint64 addr)
+{
+  struct proc *p = myproc();
+  int id;
+
+  for(id = 0; id < NSHM; id++)
+    if(SHMVA(id) == addr)
+      break;
+  if(id == NSHM || !ismapped(p->pagetable, addr))
+    return -1;
+
+  uvmunmap(p->pagetable, addr, shmtab.shm[id].npages, 0);
+  shmput(id);
+  return 0;
+}
+
+// Remove segment id: its key no longer finds it, it can't be
+// attached, and it is freed once nothing has it attached.
+// Returns 0, or -1 if there is no such segment.
+int
+shmrm(int id)
+{
+  struct shm *sh;
+
+  if(id < 0 || id >= NSHM)
+    return -1;
+  sh = &shmtab.shm[id];
+  acquire(&shmtab.lock);
+  if(!sh->used || sh->removed){
+    release(&shmtab.lock);
+    return -1;
+  }
+  sh->removed = 1;
+  sh->key = 0;
+  if(sh->ref == 0)
+    shmfree(sh);
+  release(&shmtab.lock);
+  return 0;
+}
+
+// Attach every segment attached in old to new as well.
+// Used by fork(). Returns 0 on success, -1 on failure;
+// on failure, segments already attached to new stay attached
+// and are dropped when new is freed.
+int
+shmcopy(pagetable_t old, pagetable_t new)
+{
+  acquire(&shmtab.lock);
+  for(int id = 0; id < NSHM; id++){
+    if(ismapped(old, SHMVA(id)) && shmmap(new, id) < 0){
+      release(&shmtab.lock);
+      return -1;
+    }
+  }
+  release(&shmtab.lock);
+  return 0;
+}
+
+// Detach all segments attached in pagetable, without freeing
+// the pages of segments still attached elsewhere.
+// Called by proc_freepagetable().
+void
+shmunmapall(pagetable_t pagetable)
+{
+  for(int id = 0; id < NSHM; id++){
+    if(ismapped(pagetable, SHMVA(id))){
+      uvmunmap(pagetable, SHMVA(id), shmtab.shm[id].npages, 0);
+      shmput(id);
+    }
+  }
+}
@@ -1,4 +1,12 @@
 // Sleeping locks
+//
+// A sleeplock is held either exclusively (acquiresleep) or
+// shared by readers (acquiresleepshared). Waiting exclusive
+// acquirers keep new readers out, so writers can't starve.
+//
+// Before sleeping, a waiter spins for a little while if the
+// exclusive holder is running on another CPU: short critical
+// sections are then handed over without two context switches.
 
 #include "types.h"
 #include "riscv.h"
@@ -9,37 +17,125 @@
 #include "proc.h"
 #include "sleeplock.h"
 
+// how long to spin before sleeping.
+#define SPINLIMIT 2000
+
 void
 initsleeplock(struct sleeplock *lk, char *name)
 {
-  initlock(&lk->lk, "sleep lock");
+  initlock(&lk->lk, name);
   lk->name = name;
   lk->locked = 0;
+  lk->readers = 0;
+  lk->writers = 0;
   lk->pid = 0;
+  lk->owner = 0;
+}
+
+// Spin briefly while lk is held exclusively by a process that
+// is running on another CPU, on the theory that it will
+// release lk soon. Called and returns with lk->lk held.
+static void
+spinwait(struct sleeplock *lk)
+{
+  struct proc *owner = lk->owner;
+
+  if(owner == 0 || owner == myproc())
+    return;
+  release(&lk->lk);
+  for(int i = 0; i < SPINLIMIT; i++){
+    if(*(volatile uint *)&lk->locked == 0 ||
+       *(volatile struct proc **)&lk->owner != owner ||
+       *(volatile enum procstate *)&owner->state != RUNNING)
+      break;
+  }
+  acquire(&lk->lk);
 }
 
 void
 acquiresleep(struct sleeplock *lk)
 {
+  int spun = 0;
+
   acquire(&lk->lk);
-  while (lk->locked) {
+  lk->writers++;
+  while (lk->locked || lk->readers) {
+    if(lk->locked && !spun){
+      spun = 1;
+      spinwait(lk);
+      continue;
+    }
     sleep(lk, &lk->lk);
+    spun = 0;
   }
+  lk->writers--;
   lk->locked = 1;
   lk->pid = myproc()->pid;
+  lk->owner = myproc();
   release(&lk->lk);
 }
 
+// Acquire lk exclusively if nobody holds it, without waiting.
+// Returns 1 if it did, 0 if not.
+int
+tryacquiresleep(struct sleeplock *lk)
+{
+  int r = 0;
+
+  acquire(&lk->lk);
+  if(!lk->locked && lk->readers == 0){
+    lk->locked = 1;
+    lk->pid = myproc()->pid;
+    lk->owner = myproc();
+    r = 1;
+  }
+  release(&lk->lk);
+  return r;
+}
+
 void
 releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
   lk->locked = 0;
   lk->pid = 0;
+  lk->owner = 0;
   wakeup(lk);
   release(&lk->lk);
 }
 
+// Acquire lk shared with other readers.
+void
+acquiresleepshared(struct sleeplock *lk)
+{
+  int spun = 0;
+
+  acquire(&lk->lk);
+  while (lk->locked || lk->writers) {
+    if(lk->locked && !spun){
+      spun = 1;
+      spinwait(lk);
+      continue;
+    }
+    sleep(lk, &lk->lk);
+    spun = 0;
+  }
+  lk->readers++;
+  release(&lk->lk);
+}
+
+void
+releasesleepshared(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  if(lk->readers < 1)
+    panic("releasesleepshared");
+  if(--lk->readers == 0)
+    wakeup(lk);
+  release(&lk->lk);
+}
+
+// Is the current process holding lk exclusively?
 int
 holdingsleep(struct sleeplock *lk)
 {
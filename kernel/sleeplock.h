@@ -1,10 +1,15 @@
 // Long-term locks for processes
+// Held either exclusively by one process, or shared by
+// any number of readers.
 struct sleeplock {
-  uint locked;       // Is the lock held?
+  uint locked;       // Is the lock held exclusively?
+  int readers;       // Number of shared holders
+  int writers;       // Number of processes waiting to hold it exclusively
   struct spinlock lk; // spinlock protecting this sleep lock
   
   // For debugging:
   char *name;        // Name of lock.
-  int pid;           // Process holding lock
+  int pid;           // Process holding lock exclusively
+  struct proc *owner; // ... and its proc, for spinning
 };
 
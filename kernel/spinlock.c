@@ -1,4 +1,11 @@
 // Mutual exclusion spin locks.
+//
+// These are ticket locks. A plain test-and-set lock lets
+// whichever CPU's swap happens to win take the lock, which is
+// unfair under contention, and every waiter's swap bounces the
+// lock's cache line. Here each waiter takes a ticket with a
+// single atomic add and then only reads lk->owner until its
+// turn comes, so the lock is handed over in arrival order.
 
 #include "types.h"
 #include "param.h"
@@ -6,14 +13,64 @@
 #include "spinlock.h"
 #include "riscv.h"
 #include "proc.h"
+#include "lockstat.h"
 #include "defs.h"
 
+// Every lock passed to initlock() and not yet to freelock(),
+// so that lockstat() can report on them. locklist_lock protects
+// the list itself, not the locks' counters, and is not on it.
+static struct spinlock locklist_lock;
+static struct spinlock *locklist;
+static int nlocklist;       // locks on locklist
+
+// One lock's counters, as copied out by lockstat_read().
+struct lockcount {
+  char *name;
+  uint64 nacquire;
+  uint64 ncontend;
+  uint64 nspin;
+  uint64 waittime;
+  uint64 holdtime;
+};
+#define NCOUNTPG (PGSIZE / sizeof(struct lockcount))
+
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+  lk->nacquire = 0;
+  lk->ncontend = 0;
+  lk->nspin = 0;
+  lk->waittime = 0;
+  lk->holdtime = 0;
+  lk->tacquire = 0;
+
+  acquire(&locklist_lock);
+  lk->prevlock = 0;
+  lk->nextlock = locklist;
+  if(locklist)
+    locklist->prevlock = lk;
+  locklist = lk;
+  nlocklist++;
+  release(&locklist_lock);
+}
+
+// Forget about a lock whose memory is about to be freed.
+void
+freelock(struct spinlock *lk)
+{
+  acquire(&locklist_lock);
+  if(lk->prevlock)
+    lk->prevlock->nextlock = lk->nextlock;
+  else
+    locklist = lk->nextlock;
+  if(lk->nextlock)
+    lk->nextlock->prevlock = lk->prevlock;
+  nlocklist--;
+  release(&locklist_lock);
 }
 
 // Acquire the lock.
@@ -21,16 +78,26 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket;
+  uint64 spins = 0;
+  uint64 t0;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
+  t0 = r_time();
+
+  // On RISC-V, sync_fetch_and_add turns into an atomic add:
   //   a5 = 1
-  //   s1 = &lk->locked
-  //   amoswap.w.aq a5, a5, (s1)
-  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+  //   s1 = &lk->next
+  //   amoadd.w.aqrl a5, a5, (s1)
+  ticket = __sync_fetch_and_add(&lk->next, 1);
+
+  // Wait for our turn. Plain loads, so waiting CPUs share
+  // the cache line until release() writes it.
+  while(*(volatile uint *)&lk->owner != ticket)
+    spins++;
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +107,13 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+  lk->tacquire = r_time();
+  lk->nacquire++;
+  if(spins){
+    lk->ncontend++;
+    lk->nspin += spins;
+    lk->waittime += lk->tacquire - t0;
+  }
 }
 
 // Release the lock.
@@ -49,6 +123,7 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
+  lk->holdtime += r_time() - lk->tacquire;
   lk->cpu = 0;
 
   // Tell the C compiler and the CPU to not move loads or stores
@@ -59,14 +134,14 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
+  // Hand the lock to the next ticket, equivalent to lk->owner++.
   // This code doesn't use a C assignment, since the C standard
   // implies that an assignment might be implemented with
   // multiple store instructions.
-  // On RISC-V, sync_lock_release turns into an atomic swap:
-  //   s1 = &lk->locked
-  //   amoswap.w zero, zero, (s1)
-  __sync_lock_release(&lk->locked);
+  // On RISC-V, sync_fetch_and_add turns into an atomic add:
+  //   s1 = &lk->owner
+  //   amoadd.w zero, a5, (s1)
+  __sync_fetch_and_add(&lk->owner, 1);
 
   pop_off();
 }
@@ -77,7 +152,7 @@ int
 holding(struct spinlock *lk)
 {
   int r;
-  r = (lk->locked && lk->cpu == mycpu());
+  r = (lk->owner != lk->next && lk->cpu == mycpu());
   return r;
 }
 
@@ -111,3 +186,174 @@ pop_off(void)
   if(c->noff == 0 && c->intena)
     intr_on();
 }
+
+// Add lk's counters into st.
+static void
+lockstat_add(struct lockstat *st, struct lockcount *lk)
+{
+  st->nlocks++;
+  st->nacquire += lk->nacquire;
+  st->ncontend += lk->ncontend;
+  st->nspin += lk->nspin;
+  st->waittime += lk->waittime;
+  st->holdtime += lk->holdtime;
+}
+
+// Copy statistics for up to n lock names, most contended first,
+// to the user array at addr. Locks with the same name (e.g. all
+// "proc" locks) are summed. Counters are read without holding
+// the locks, so they are only approximately consistent.
+// The counters are copied out under locklist_lock, which
+// interrupts are off for, and summed by name after it is
+// released; locks added since the pages were allocated are
+// left out.
+// Returns the number of entries copied, or -1.
+int
+lockstat_read(uint64 addr, int n)
+{
+  struct lockstat *st, tmp;
+  struct lockcount **pg, *c;
+  struct spinlock *lk;
+  int i, j, npg, ncount, nst = 0;
+  int max = PGSIZE / sizeof(struct lockstat);
+
+  if((st = (struct lockstat *)kalloc()) == 0)
+    return -1;
+  memset(st, 0, PGSIZE);
+  if((pg = (struct lockcount **)kalloc()) == 0){
+    kfree(st);
+    return -1;
+  }
+  npg = (nlocklist + NCOUNTPG - 1) / NCOUNTPG + 1;
+  if(npg > PGSIZE / sizeof(pg[0]))
+    npg = PGSIZE / sizeof(pg[0]);
+  for(i = 0; i < npg; i++)
+    if((pg[i] = (struct lockcount *)kalloc()) == 0)
+      break;
+  npg = i;
+
+  acquire(&locklist_lock);
+  ncount = 0;
+  for(lk = locklist; lk && ncount < npg * NCOUNTPG; lk = lk->nextlock){
+    c = &pg[ncount / NCOUNTPG][ncount % NCOUNTPG];
+    c->name = lk->name;
+    c->nacquire = lk->nacquire;
+    c->ncontend = lk->ncontend;
+    c->nspin = lk->nspin;
+    c->waittime = lk->waittime;
+    c->holdtime = lk->holdtime;
+    ncount++;
+  }
+  release(&locklist_lock);
+
+  for(j = 0; j < ncount; j++){
+    c = &pg[j / NCOUNTPG][j % NCOUNTPG];
+    for(i = 0; i < nst; i++)
+      if(strncmp(st[i].name, c->name, sizeof(st[i].name)-1) == 0)
+        break;
+    if(i == nst){
+      if(nst == max)
+        continue;
+      safestrcpy(st[i].name, c->name, sizeof(st[i].name));
+      nst++;
+    }
+    lockstat_add(&st[i], c);
+  }
+  for(i = 0; i < npg; i++)
+    kfree(pg[i]);
+  kfree(pg);
+
+  // sort by contention, then convert times to microseconds.
+  for(i = 1; i < nst; i++){
+    tmp = st[i];
+    for(j = i; j > 0 && st[j-1].ncontend < tmp.ncontend; j--)
+      st[j] = st[j-1];
+    st[j] = tmp;
+  }
+  for(i = 0; i < nst; i++){
+    st[i].waittime /= TIMEFREQ / 1000000;
+    st[i].holdtime /= TIMEFREQ / 1000000;
+  }
+
+  if(n > nst)
+    n = nst;
+  if(n < 0 || copyout(myproc()->pagetable, addr, (char *)st, n * sizeof(*st)) < 0)
+    n = -1;
+  kfree(st);
+  return n;
+}
+
+// Copy the statistics of the single lock lk to the user
+// struct lockstat at addr. Returns 0, or -1.
+int
+lockstat_lock(struct spinlock *lk, uint64 addr)
+{
+  struct lockstat st;
+
+  memset(&st, 0, sizeof(st));
+  safestrcpy(st.name, lk->name, sizeof(st.name));
+  st.nlocks = 1;
+  st.nacquire = lk->nacquire;
+  st.ncontend = lk->ncontend;
+  st.nspin = lk->nspin;
+  st.waittime = lk->waittime / (TIMEFREQ / 1000000);
+  st.holdtime = lk->holdtime / (TIMEFREQ / 1000000);
+  return copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st));
+}
+
+// Zero the counters of every lock.
+// Races with concurrent acquire()s; good enough for profiling.
+void
+lockstat_reset(void)
+{
+  struct spinlock *lk;
+
+  acquire(&locklist_lock);
+  for(lk = locklist; lk; lk = lk->nextlock){
+    lk->nacquire = 0;
+    lk->ncontend = 0;
+    lk->nspin = 0;
+    lk->waittime = 0;
+    lk->holdtime = 0;
+  }
+  release(&locklist_lock);
+}
+
+// Begin a write to the data protected by sl.
+// The caller must exclude other writers.
+void
+writeseqbegin(struct seqlock *sl)
+{
+  __atomic_store_n(&sl->seq, sl->seq + 1, __ATOMIC_RELAXED);
+  __sync_synchronize();
+}
+
+void
+writeseqend(struct seqlock *sl)
+{
+  __sync_synchronize();
+  __atomic_store_n(&sl->seq, sl->seq + 1, __ATOMIC_RELAXED);
+}
+
+// Begin a read of the data protected by sl, waiting out
+// any write in progress. Returns the sequence number to
+// pass to readseqretry().
+uint
+readseqbegin(struct seqlock *sl)
+{
+  uint seq;
+
+  while((seq = __atomic_load_n(&sl->seq, __ATOMIC_RELAXED)) & 1)
+    ;
+  __sync_synchronize();
+  return seq;
+}
+
+// Did a write happen during the read that began with seq?
+// If so, the data read may be inconsistent; read it again.
+int
+readseqretry(struct seqlock *sl, uint seq)
+{
+  __sync_synchronize();
+  return __atomic_load_n(&sl->seq, __ATOMIC_RELAXED) != seq;
+}
@@ -1,9 +1,31 @@
 // Mutual exclusion lock.
+// A ticket lock: acquire() takes the next ticket and spins
+// until owner reaches it, so waiters get the lock in FIFO order.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  uint next;         // Next ticket to hand out
+  uint owner;        // Ticket that holds the lock
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+
+  // Statistics, updated while holding the lock:
+  uint64 nacquire;   // Number of acquire()s
+  uint64 ncontend;   // acquire()s that had to wait
+  uint64 nspin;      // Total spin iterations while waiting
+  uint64 waittime;   // Total time CSR ticks spent waiting
+  uint64 holdtime;   // Total time CSR ticks held
+  uint64 tacquire;   // time CSR when last acquired
+
+  // List of all locks, for lockstat():
+  struct spinlock *prevlock;
+  struct spinlock *nextlock;
 };
 
+// Sequence lock, for data that is read often and written rarely.
+// Readers never block the writer and never write the lock: they
+// read seq, read the data, and retry if seq was odd or changed.
+// Writers must be serialized by some other lock.
+struct seqlock {
+  uint seq;          // Odd while a write is in progress
+};
@@ -101,6 +101,20 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_link(void);
 extern uint64 sys_mkdir(void);
 extern uint64 sys_close(void);
+extern uint64 sys_futex_wait(void);
+extern uint64 sys_futex_wake(void);
+extern uint64 sys_shmget(void);
+extern uint64 sys_shmat(void);
+extern uint64 sys_shmdt(void);
+extern uint64 sys_setaffinity(void);
+extern uint64 sys_getaffinity(void);
+extern uint64 sys_getrusage(void);
+extern uint64 sys_waitpid(void);
+extern uint64 sys_lockstat(void);
+extern uint64 sys_bstat(void);
+extern uint64 sys_diskstat(void);
+extern uint64 sys_sync(void);
+extern uint64 sys_shmrm(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -126,6 +140,20 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_futex_wait] sys_futex_wait,
+[SYS_futex_wake] sys_futex_wake,
+[SYS_shmget]  sys_shmget,
+[SYS_shmat]   sys_shmat,
+[SYS_shmdt]   sys_shmdt,
+[SYS_setaffinity] sys_setaffinity,
+[SYS_getaffinity] sys_getaffinity,
+[SYS_getrusage] sys_getrusage,
+[SYS_waitpid] sys_waitpid,
+[SYS_lockstat] sys_lockstat,
+[SYS_bstat]   sys_bstat,
+[SYS_diskstat] sys_diskstat,
+[SYS_sync]    sys_sync,
+[SYS_shmrm]   sys_shmrm,
 };
 
 void
@@ -20,3 +20,17 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_futex_wait 22
+#define SYS_futex_wake 23
+#define SYS_shmget 24
+#define SYS_shmat  25
+#define SYS_shmdt  26
+#define SYS_setaffinity 27
+#define SYS_getaffinity 28
+#define SYS_getrusage 29
+#define SYS_waitpid 30
+#define SYS_lockstat 31
+#define SYS_bstat 32
+#define SYS_diskstat 33
+#define SYS_sync   34
+#define SYS_shmrm  35
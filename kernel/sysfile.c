@@ -503,3 +503,11 @@ sys_pipe(void)
   }
   return 0;
 }
+
+// wait for completed FS system calls to reach the disk.
+uint64
+sys_sync(void)
+{
+  log_sync();
+  return 0;
+}
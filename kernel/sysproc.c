@@ -5,6 +5,9 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "rusage.h"
+#include "lockstat.h"
+#include "bstat.h"
 #include "vm.h"
 
 uint64
@@ -33,7 +36,21 @@ sys_wait(void)
 {
   uint64 p;
   argaddr(0, &p);
-  return kwait(p);
+  return kwait(-1, p, 0);
+}
+
+// wait for a specific child (or any, if pid is -1);
+// with WNOHANG, return 0 rather than block.
+uint64
+sys_waitpid(void)
+{
+  int pid, options;
+  uint64 p;
+
+  argint(0, &pid);
+  argaddr(1, &p);
+  argint(2, &options);
+  return kwait(pid, p, options);
 }
 
 uint64
@@ -55,7 +72,7 @@ sys_sbrk(void)
     // Lazily allocate memory for this process: increase its memory
     // size but don't allocate memory. If the processes uses the
     // memory, vmfault() will allocate it.
-    if(addr + n < addr)
+    if(addr + n < addr || addr + n > SHMBASE)
       return -1;
     myproc()->sz += n;
   }
@@ -69,10 +86,10 @@ sys_pause(void)
   uint ticks0;
 
   argint(0, &n);
-  if(n < 0)
-    n = 0;
+  if(n <= 0)
+    return 0;
+  ticks0 = readticks();
   acquire(&tickslock);
-  ticks0 = ticks;
   while(ticks - ticks0 < n){
     if(killed(myproc())){
       release(&tickslock);
@@ -98,10 +115,182 @@ sys_kill(void)
 uint64
 sys_uptime(void)
 {
-  uint xticks;
+  return readticks();
+}
 
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+// block until the word at addr no longer holds val
+// and another process calls futex_wake() on it.
+uint64
+sys_futex_wait(void)
+{
+  uint64 addr;
+  int val;
+
+  argaddr(0, &addr);
+  argint(1, &val);
+  return futexwait(addr, (uint32)val);
+}
+
+// wake up to n processes blocked in futex_wait() on addr.
+uint64
+sys_futex_wake(void)
+{
+  uint64 addr;
+  int n;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  return futexwake(addr, n);
+}
+
+// return the id of the shared memory segment named key,
+// creating one of at least size bytes if needed.
+uint64
+sys_shmget(void)
+{
+  int key, size;
+
+  argint(0, &key);
+  argint(1, &size);
+  return shmget(key, size);
+}
+
+// map a shared memory segment; returns its address.
+uint64
+sys_shmat(void)
+{
+  int id;
+
+  argint(0, &id);
+  return shmat(id);
+}
+
+uint64
+sys_shmdt(void)
+{
+  uint64 addr;
+
+  argaddr(0, &addr);
+  return shmdt(addr);
+}
+
+// remove a shared memory segment once it is no longer attached.
+uint64
+sys_shmrm(void)
+{
+  int id;
+
+  argint(0, &id);
+  return shmrm(id);
+}
+
+// restrict a process (0 for self) to the CPUs in a mask.
+uint64
+sys_setaffinity(void)
+{
+  int pid, mask;
+
+  argint(0, &pid);
+  argint(1, &mask);
+  return setaffinity(pid, mask);
+}
+
+uint64
+sys_getaffinity(void)
+{
+  int pid;
+
+  argint(0, &pid);
+  return getaffinity(pid);
+}
+
+// copy resource usage of self, children, or a pid
+// to a user struct rusage.
+uint64
+sys_getrusage(void)
+{
+  int who;
+  uint64 addr;
+  struct usage u;
+  struct rusage ru;
+
+  argint(0, &who);
+  argaddr(1, &addr);
+  if(getusage(who, &u) < 0)
+    return -1;
+  ru.utime = u.utime / (TIMEFREQ / 1000000);
+  ru.stime = u.stime / (TIMEFREQ / 1000000);
+  ru.nvcsw = u.nvcsw;
+  ru.nivcsw = u.nivcsw;
+  ru.pgfaults = u.pgfaults;
+  ru.inblock = u.inblock;
+  ru.oublock = u.oublock;
+  if(copyout(myproc()->pagetable, addr, (char *)&ru, sizeof(ru)) < 0)
+    return -1;
+  return 0;
+}
+
+// report (LOCKSTAT_READ) or reset (LOCKSTAT_RESET)
+// spinlock contention statistics.
+uint64
+sys_lockstat(void)
+{
+  int cmd, n;
+  uint64 addr;
+
+  argint(0, &cmd);
+  argaddr(1, &addr);
+  argint(2, &n);
+  if(cmd == LOCKSTAT_RESET){
+    lockstat_reset();
+    return 0;
+  }
+  if(cmd == LOCKSTAT_READ)
+    return lockstat_read(addr, n);
+  if(cmd == LOCKSTAT_FD){
+    struct file *f;
+    if(n < 0 || n >= NOFILE || (f = myproc()->ofile[n]) == 0)
+      return -1;
+    return filelockstat(f, addr);
+  }
+  return -1;
+}
+
+// buffer cache statistics; see bstat.h.
+uint64
+sys_bstat(void)
+{
+  int cmd, n;
+  uint64 addr;
+
+  argint(0, &cmd);
+  argaddr(1, &addr);
+  argint(2, &n);
+  if(cmd == BSTAT_RESET){
+    bstat_reset();
+    return 0;
+  }
+  if(cmd == BSTAT_DROP){
+    pcshrink();
+    bstat_drop();
+    return 0;
+  }
+  if(cmd == BSTAT_READ)
+    return bstat_read(addr);
+  if(cmd == BSTAT_HOT)
+    return bstat_hot(addr, n);
+  return -1;
+}
+
+// disk driver statistics; see diskstat.h.
+uint64
+sys_diskstat(void)
+{
+  int cmd, n;
+  uint64 addr;
+
+  argint(0, &cmd);
+  argaddr(1, &addr);
+  argint(2, &n);
+  return virtio_disk_stat(cmd, addr, n);
 }
@@ -6,7 +6,8 @@
 #include "proc.h"
 #include "defs.h"
 
-struct spinlock tickslock;
+struct spinlock tickslock;  // serializes updates; condition lock for sleep(&ticks)
+struct seqlock tickseq;     // lets readticks() read ticks without tickslock
 uint ticks;
 
 extern char trampoline[], uservec[];
@@ -22,6 +23,20 @@ trapinit(void)
   initlock(&tickslock, "time");
 }
 
+// Return the number of clock ticks since boot,
+// without taking tickslock.
+uint
+readticks(void)
+{
+  uint seq, t;
+
+  do {
+    seq = readseqbegin(&tickseq);
+    t = ticks;
+  } while(readseqretry(&tickseq, seq));
+  return t;
+}
+
 // set up to take exceptions and traps while in the kernel.
 void
 trapinithart(void)
@@ -47,6 +62,11 @@ usertrap(void)
   w_stvec((uint64)kernelvec);
 
   struct proc *p = myproc();
+
+  // charge the time since the last return to user space.
+  uint64 now = r_time();
+  p->usage.utime += now - p->tstamp;
+  p->tstamp = now;
   
   // save user program counter.
   p->trapframe->epc = r_sepc();
@@ -128,6 +148,11 @@ prepare_return(void)
 
   // set S Exception Program Counter to the saved user pc.
   w_sepc(p->trapframe->epc);
+
+  // charge the time spent in the kernel since the trap.
+  uint64 now = r_time();
+  p->usage.stime += now - p->tstamp;
+  p->tstamp = now;
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -166,7 +191,9 @@ clockintr()
 {
   if(cpuid() == 0){
     acquire(&tickslock);
+    writeseqbegin(&tickseq);
     ticks++;
+    writeseqend(&tickseq);
     wakeup(&ticks);
     release(&tickslock);
   }
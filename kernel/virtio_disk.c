@@ -12,13 +12,25 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "proc.h"
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "diskstat.h"
 
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
 
+// most bufs in one request, with indirect descriptors;
+// without them, DIRECTSEG (see diskstat.h).
+#define MAXSEG 30
+
+// bytes in an indirect descriptor table.
+#define INDIRSZ ((MAXSEG + 2) * sizeof(struct virtq_desc))
+
+// default polling budget, in microseconds.
+#define POLLUS 20
+
 static struct disk {
   // a set (not a ring) of DMA descriptors, with which the
   // driver tells the device where to read and write individual
@@ -48,13 +60,41 @@ static struct disk {
   struct {
     struct buf *b;
     char status;
+    uint64 start;  // time CSR when queued
+    int depth;     // disk.inflight when queued
+    uint16 seq;    // avail ring index it was queued at
   } info[NUM];
 
   // disk command headers.
   // one-for-one with descriptors, for convenience.
   struct virtio_blk_req ops[NUM];
+
+  // with INDIRECT_DESC, a request takes a single ring
+  // descriptor, which points to indir[head], a table holding
+  // the request's header, data, and status descriptors.
+  int indirect;
+  struct virtq_desc *indir[NUM];
+  int maxseg;      // most bufs in one request
+
+  // with EVENT_IDX, the device interrupts only when the used
+  // ring passes avail->used_event, and wants a notification
+  // only when the avail ring passes used->avail_event.
+  int eventidx;
+  uint16 kicked;   // avail->idx as of the last notify().
+  int inflight;    // requests on the avail ring, not yet completed.
   
   struct spinlock vdisk_lock;
+
+  // a process waiting for a request spins for up to
+  // pollticks time CSR ticks, checking the used ring
+  // itself, before sleeping until the interrupt.
+  uint64 pollticks;
+  struct diskstat stat;
+
+  // with stat.tracing, a ring of the last NTRACE requests
+  // to finish; trace[tracetail..tracehead-1] are undumped.
+  struct disktrace trace[NTRACE];
+  uint tracehead, tracetail;
   
 } disk;
 
@@ -64,6 +104,7 @@ virtio_disk_init(void)
   uint32 status = 0;
 
   initlock(&disk.vdisk_lock, "virtio_disk");
+  disk.pollticks = POLLUS * (TIMEFREQ / 1000000);
 
   if(*R(VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
      *R(VIRTIO_MMIO_VERSION) != 2 ||
@@ -90,9 +131,10 @@ virtio_disk_init(void)
   features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
   features &= ~(1 << VIRTIO_BLK_F_MQ);
   features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
-  features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
-  features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
   *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
+  disk.indirect = (features >> VIRTIO_RING_F_INDIRECT_DESC) & 1;
+  disk.eventidx = (features >> VIRTIO_RING_F_EVENT_IDX) & 1;
+  disk.maxseg = disk.indirect ? MAXSEG : DIRECTSEG;
 
   // tell device that feature negotiation is complete.
   status |= VIRTIO_CONFIG_S_FEATURES_OK;
@@ -127,6 +169,19 @@ virtio_disk_init(void)
   memset(disk.avail, 0, PGSIZE);
   memset(disk.used, 0, PGSIZE);
 
+  // indirect descriptor tables, several to a page.
+  if(disk.indirect){
+    char *pg = 0;
+    for(int i = 0; i < NUM; i++){
+      if(i % (PGSIZE / INDIRSZ) == 0){
+        if((pg = kalloc()) == 0)
+          panic("virtio disk kalloc");
+        memset(pg, 0, PGSIZE);
+      }
+      disk.indir[i] = (struct virtq_desc *)(pg + (i % (PGSIZE / INDIRSZ)) * INDIRSZ);
+    }
+  }
+
   // set queue size.
   *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
 
@@ -178,7 +233,6 @@ free_desc(int i)
   disk.desc[i].flags = 0;
   disk.desc[i].next = 0;
   disk.free[i] = 1;
-  wakeup(&disk.free[0]);
 }
 
 // free a chain of descriptors.
@@ -196,12 +250,11 @@ free_chain(int i)
   }
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
+// allocate n descriptors (they need not be contiguous).
 static int
-alloc3_desc(int *idx)
+alloc_descs(int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
+  for(int i = 0; i < n; i++){
     idx[i] = alloc_desc();
     if(idx[i] < 0){
       for(int j = 0; j < i; j++)
@@ -212,28 +265,39 @@ alloc3_desc(int *idx)
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// format a request to read or write the n bufs in bs, which
+// hold consecutive blocks of the disk, and put it on the avail
+// ring. idx holds the request's descriptors: one that points
+// to an indirect table if disk.indirect, otherwise n+2.
+// the device won't look at it until notify().
+// caller must hold vdisk_lock.
+static void
+queue(struct buf **bs, int n, int write, int *idx)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
-
-  acquire(&disk.vdisk_lock);
-
-  // the spec's Section 5.2 says that legacy block operations use
-  // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
+  uint64 sector = bs[0]->blockno * (BSIZE / 512);
+  struct virtq_desc *d;
+  int i, seq[MAXSEG+2];
 
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
-  }
-
-  // format the three descriptors.
+  // the spec's Section 5.2 says that legacy block operations
+  // use a descriptor for type/reserved/sector, descriptors for
+  // the data, and one for a 1-byte status result.
   // qemu's virtio-blk.c reads them.
+  // an indirect table holds the same chain, linked by
+  // position in the table.
+
+  if(disk.indirect){
+    d = disk.indir[idx[0]];
+    for(i = 0; i < n+2; i++)
+      seq[i] = i;
+    disk.desc[idx[0]].addr = (uint64) d;
+    disk.desc[idx[0]].len = (n+2) * sizeof(struct virtq_desc);
+    disk.desc[idx[0]].flags = VRING_DESC_F_INDIRECT;
+    disk.desc[idx[0]].next = 0;
+  } else {
+    d = disk.desc;
+    for(i = 0; i < n+2; i++)
+      seq[i] = idx[i];
+  }
 
   struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
 
@@ -244,29 +308,39 @@ virtio_disk_rw(struct buf *b, int write)
   buf0->reserved = 0;
   buf0->sector = sector;
 
-  disk.desc[idx[0]].addr = (uint64) buf0;
-  disk.desc[idx[0]].len = sizeof(struct virtio_blk_req);
-  disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
-  disk.desc[idx[0]].next = idx[1];
-
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  d[seq[0]].addr = (uint64) buf0;
+  d[seq[0]].len = sizeof(struct virtio_blk_req);
+  d[seq[0]].flags = VRING_DESC_F_NEXT;
+  d[seq[0]].next = seq[1];
+
+  // one data descriptor per buf, scattered across memory.
+  for(i = 0; i < n; i++){
+    d[seq[i+1]].addr = (uint64) bs[i]->data;
+    d[seq[i+1]].len = BSIZE;
+    if(write)
+      d[seq[i+1]].flags = 0; // device reads b->data
+    else
+      d[seq[i+1]].flags = VRING_DESC_F_WRITE; // device writes b->data
+    d[seq[i+1]].flags |= VRING_DESC_F_NEXT;
+    d[seq[i+1]].next = seq[i+2];
+  }
 
   disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
-
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  d[seq[n+1]].addr = (uint64) &disk.info[idx[0]].status;
+  d[seq[n+1]].len = 1;
+  d[seq[n+1]].flags = VRING_DESC_F_WRITE; // device writes the status
+  d[seq[n+1]].next = 0;
+
+  // record the bufs for virtio_disk_intr().
+  for(i = 0; i < n; i++){
+    bs[i]->disk = 1;
+    bs[i]->ionext = i+1 < n ? bs[i+1] : 0;
+  }
+  disk.info[idx[0]].b = bs[0];
+  disk.inflight++;
+  disk.info[idx[0]].start = r_time();
+  disk.info[idx[0]].depth = disk.inflight;
+  disk.info[idx[0]].seq = disk.avail->idx;
 
   // tell the device the first index in our chain of descriptors.
   disk.avail->ring[disk.avail->idx % NUM] = idx[0];
@@ -275,19 +349,234 @@ virtio_disk_rw(struct buf *b, int write)
 
   // tell the device another avail ring entry is available.
   disk.avail->idx += 1; // not % NUM ...
+}
+
+// has idx moved past event since it was old? from the spec.
+static int
+need_event(uint16 event, uint16 idx, uint16 old)
+{
+  return (uint16)(idx - event - 1) < (uint16)(idx - old);
+}
+
+// ring the doorbell: tell the device to look at the avail ring.
+// with EVENT_IDX, skips the doorbell if the device is still
+// working through the ring and has said it will look again.
+static void
+notify(void)
+{
+  uint16 old = disk.kicked;
 
   __sync_synchronize();
 
+  disk.kicked = disk.avail->idx;
+  if(disk.eventidx && !need_event(disk.used->avail_event, disk.kicked, old))
+    return;
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+  disk.stat.notifies++;
+}
+
+// count a request that took t time CSR ticks in the latency
+// histogram and, if tracing, the trace ring.
+// caller must hold vdisk_lock.
+static void
+record(int id, int nblocks, uint64 t)
+{
+  int w = disk.ops[id].type == VIRTIO_BLK_T_OUT;
+  uint64 us = t / (TIMEFREQ / 1000000);
+  struct disktrace *tr;
+  int i;
+
+  for(i = 0; i < NLAT-1 && (us >> (i+1)) != 0; i++)
+    ;
+  disk.stat.lat[w][i]++;
+
+  if(!disk.stat.tracing)
+    return;
+  if(disk.tracehead - disk.tracetail == NTRACE){
+    disk.tracetail++;
+    disk.stat.tracelost++;
+  }
+  tr = &disk.trace[disk.tracehead++ % NTRACE];
+  tr->when = r_time() / (TIMEFREQ / 1000000);
+  tr->sector = disk.ops[id].sector;
+  tr->nblocks = nblocks;
+  tr->write = w;
+  tr->depth = disk.info[id].depth;
+  tr->latency = us;
+}
+
+// finish the requests the device has added to the used
+// ring since we last looked, waking up their waiters.
+// returns the number of requests finished.
+// caller must hold vdisk_lock.
+static int
+complete(void)
+{
+  int n = 0, nblocks;
+
+  // the device increments disk.used->idx when it
+  // adds an entry to the used ring.
+
+  while(disk.used_idx != disk.used->idx){
+    n++;
+    __sync_synchronize();
+    int id = disk.used->ring[disk.used_idx % NUM].id;
+    uint64 t = r_time() - disk.info[id].start;
+
+    if(disk.info[id].status != 0)
+      panic("virtio_disk status");
+
+    struct buf *b = disk.info[id].b, *next;
+    disk.info[id].b = 0;
+    disk.inflight--;
+
+    for(nblocks = 0; b; b = next){
+      // once b->disk is clear, b may be reused.
+      next = b->ionext;
+      void (*iodone)(struct buf *) = b->iodone;
+      b->disk = 0;   // disk is done with buf
+      wakeup(b);
+      if(iodone)
+        iodone(b);
+      nblocks++;
+    }
 
-  // Wait for virtio_disk_intr() to say request has finished.
-  while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
+    record(id, nblocks, t);
+    free_chain(id);
+    disk.used_idx += 1;
   }
+  return n;
+}
+
+// is a process sleeping on a buf of the request
+// whose chain starts at descriptor id?
+static int
+waited(int id)
+{
+  struct buf *b;
+
+  for(b = disk.info[id].b; b; b = b->ionext)
+    if(b->iowait)
+      return 1;
+  return 0;
+}
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+// with EVENT_IDX, tell the device when to interrupt next: once
+// the oldest request that a process is sleeping on is done,
+// or if there is none, once every request in flight is done,
+// so that a deep queue of write-back or read-ahead, or a
+// batch whose last buf is waited for first, costs a single
+// interrupt. the device completes requests in order, or if
+// not, the interrupt comes early and we re-arm. then finish
+// anything that completed before the device could see the
+// new used_event, since it won't interrupt for those.
+// returns the number finished.
+// caller must hold vdisk_lock.
+static int
+rearm(void)
+{
+  int n = 0, id, k, at;
 
+  if(!disk.eventidx)
+    return 0;
+  while(1){
+    at = disk.inflight > 0 ? disk.inflight - 1 : 0;
+    for(id = 0; id < NUM; id++){
+      if(disk.info[id].b == 0 || !waited(id))
+        continue;
+      k = (short)(disk.info[id].seq - disk.used_idx);
+      if(k < at)
+        at = k < 0 ? 0 : k;
+    }
+    disk.avail->used_event = disk.used_idx + at;
+    __sync_synchronize();
+    if(*(volatile uint16 *)&disk.used->idx == disk.used_idx)
+      return n;
+    n += complete();
+  }
+}
+
+// queue requests to read or write each of the n bufs in bs,
+// ringing the doorbell once. runs of bufs holding consecutive
+// blocks go in one request of up to MAXSEG blocks.
+// doesn't wait for the requests to finish: virtio_disk_intr()
+// clears b->disk and wakes up b when b's request is done, and
+// calls b->iodone(b) if it is set.
+// queues only as many requests as there are free descriptors
+// for, and returns the number of bufs queued. the I/O
+// scheduler, the only caller, sends the rest once requests
+// finish.
+int
+virtio_disk_submit(struct buf **bs, int n, int write)
+{
+  int i, k, nd, idx[MAXSEG+2], unseen = 0;
+
+  acquire(&disk.vdisk_lock);
+
+  for(i = 0; i < n; i += k){
+    for(k = 1; i+k < n && k < disk.maxseg; k++)
+      if(bs[i+k]->dev != bs[i]->dev || bs[i+k]->blockno != bs[i+k-1]->blockno + 1)
+        break;
+    nd = disk.indirect ? 1 : k+2;
+    if(alloc_descs(idx, nd) != 0)
+      break;
+    queue(&bs[i], k, write, idx);
+    disk.stat.requests++;
+    unseen++;
+  }
+
+  if(unseen){
+    notify();
+    disk.stat.intr += rearm();
+  }
+  release(&disk.vdisk_lock);
+  return i;
+}
+
+// wait for the request for b to finish.
+// polls the used ring for a while, since an interrupt, wakeup
+// and context switch cost more than a short request takes.
+void
+virtio_disk_wait(struct buf *b)
+{
+  uint64 deadline;
+  int n = 0;
+
+  acquire(&disk.vdisk_lock);
+  if(b->disk == 1 && disk.pollticks > 0){
+    deadline = r_time() + disk.pollticks;
+    while(b->disk == 1 && r_time() < deadline){
+      // spin without the lock, so the interrupt handler
+      // and other submitters aren't held up.
+      release(&disk.vdisk_lock);
+      while(*(volatile uint16 *)&disk.used->idx == disk.used_idx &&
+            r_time() < deadline)
+        ;
+      acquire(&disk.vdisk_lock);
+      n += complete();
+    }
+    disk.stat.polled += n;
+    if(b->disk == 1)
+      disk.stat.pollmiss++;
+    else
+      disk.stat.pollhit++;
+  }
+  while(b->disk == 1){
+    if(n > 0){
+      // the device has room again, and b may still be
+      // waiting in the I/O scheduler for it.
+      release(&disk.vdisk_lock);
+      iokick();
+      acquire(&disk.vdisk_lock);
+      n = 0;
+      continue;
+    }
+    b->iowait++;
+    if((n = rearm()) == 0)
+      sleep(b, &disk.vdisk_lock);
+    disk.stat.polled += n;
+    b->iowait--;
+  }
   release(&disk.vdisk_lock);
 }
 
@@ -306,22 +595,71 @@ virtio_disk_intr()
 
   __sync_synchronize();
 
-  // the device increments disk.used->idx when it
-  // adds an entry to the used ring.
-
-  while(disk.used_idx != disk.used->idx){
-    __sync_synchronize();
-    int id = disk.used->ring[disk.used_idx % NUM].id;
+  disk.stat.interrupts++;
+  disk.stat.intr += complete();
+  disk.stat.intr += rearm();
 
-    if(disk.info[id].status != 0)
-      panic("virtio_disk_intr status");
+  release(&disk.vdisk_lock);
 
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+  iokick();
+}
 
-    disk.used_idx += 1;
+// diskstat() system call support; see diskstat.h.
+int
+virtio_disk_stat(int cmd, uint64 addr, int n)
+{
+  struct diskstat st;
+  struct disktrace tr;
+  int i;
+
+  if(cmd == DISKSTAT_RESET){
+    acquire(&disk.vdisk_lock);
+    i = disk.stat.tracing;
+    memset(&disk.stat, 0, sizeof(disk.stat));
+    disk.stat.tracing = i;
+    release(&disk.vdisk_lock);
+    iosched_stat(0);
+  } else if(cmd == DISKSTAT_POLL && n >= 0){
+    acquire(&disk.vdisk_lock);
+    disk.pollticks = n * (TIMEFREQ / 1000000);
+    release(&disk.vdisk_lock);
+  } else if(cmd == DISKSTAT_TRACE){
+    acquire(&disk.vdisk_lock);
+    // starting discards old records; stopping keeps
+    // them for DISKSTAT_DUMP.
+    if(n && !disk.stat.tracing){
+      disk.stat.tracelost = 0;
+      disk.tracehead = disk.tracetail = 0;
+    }
+    disk.stat.tracing = n != 0;
+    release(&disk.vdisk_lock);
+  } else if(cmd == DISKSTAT_DUMP){
+    // copy out one record at a time, since copyout()
+    // may fault and must not hold the lock.
+    for(i = 0; i < n; i++){
+      acquire(&disk.vdisk_lock);
+      if(disk.tracetail == disk.tracehead){
+        release(&disk.vdisk_lock);
+        break;
+      }
+      tr = disk.trace[disk.tracetail++ % NTRACE];
+      release(&disk.vdisk_lock);
+      if(copyout(myproc()->pagetable, addr + i*sizeof(tr), (char *)&tr, sizeof(tr)) < 0)
+        return -1;
+    }
+    return i;
+  } else if(cmd == DISKSTAT_READ){
+    acquire(&disk.vdisk_lock);
+    st = disk.stat;
+    st.pollus = disk.pollticks / (TIMEFREQ / 1000000);
+    st.indirect = disk.indirect;
+    st.eventidx = disk.eventidx;
+    st.maxseg = disk.maxseg;
+    release(&disk.vdisk_lock);
+    iosched_stat(&st);
+    return copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st));
+  } else {
+    return -1;
   }
-
-  release(&disk.vdisk_lock);
+  return 0;
 }
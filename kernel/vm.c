@@ -13,6 +13,12 @@
  */
 pagetable_t kernel_pagetable;
 
+// kvm_lock serializes additions to kernel_pagetable after boot.
+// kvmgen counts them, so that each CPU can tell whether it
+// must flush its TLB (see kvmsync()).
+struct spinlock kvm_lock;
+uint kvmgen;
+
 extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
@@ -45,8 +51,7 @@ kvmmake(void)
   // the highest virtual address in the kernel.
   kvmmap(kpgtbl, TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
 
-  // allocate and map a kernel stack for each process.
-  proc_mapstacks(kpgtbl);
+  // kernel stacks are mapped on demand by allocproc().
   
   return kpgtbl;
 }
@@ -65,9 +70,49 @@ kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
 void
 kvminit(void)
 {
+  initlock(&kvm_lock, "kvm");
   kernel_pagetable = kvmmake();
 }
 
+// Allocate a zeroed page and map it read/write at va in the
+// kernel page table, e.g. for a kernel stack.
+// Returns 0, or -1 if out of memory.
+int
+kvmalloc(uint64 va)
+{
+  char *pa;
+
+  if((pa = kalloc()) == 0)
+    return -1;
+  memset(pa, 0, PGSIZE);
+
+  acquire(&kvm_lock);
+  if(mappages(kernel_pagetable, va, PGSIZE, (uint64)pa, PTE_R | PTE_W) != 0){
+    release(&kvm_lock);
+    kfree(pa);
+    return -1;
+  }
+  kvmgen++;
+  release(&kvm_lock);
+
+  kvmsync();
+  return 0;
+}
+
+// Flush this CPU's TLB if kernel mappings have been added since
+// it last did, so it can't use a stale invalid translation.
+void
+kvmsync(void)
+{
+  push_off();
+  struct cpu *c = mycpu();
+  if(c->kvmgen != kvmgen){
+    c->kvmgen = kvmgen;
+    sfence_vma();
+  }
+  pop_off();
+}
+
 // Switch the current CPU's h/w page table register to
 // the kernel's page table, and enable paging.
 void
@@ -469,6 +514,7 @@ vmfault(pagetable_t pagetable, uint64 va, int read)
     kfree((void *)mem);
     return 0;
   }
+  p->usage.pgfaults++;
   return mem;
 }
 
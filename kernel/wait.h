@@ -0,0 +1,4 @@
+// Options for waitpid().
+// Both the kernel and user programs use this header file.
+
+#define WNOHANG  0x1   // return 0 instead of blocking
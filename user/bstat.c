@@ -0,0 +1,108 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/bstat.h"
+#include "user/user.h"
+
+// Print buffer cache statistics.
+//   bstat              print counters by block class
+//   bstat -h [n]       print the n most used cached blocks
+//   bstat -r           reset the counters
+//   bstat -d           drop cached blocks nobody is using
+//   bstat cmd args...  reset, run cmd, then print
+
+#define NHEAT 20
+
+char *classname[NBCLASS] = {
+[BC_SUPER]  "super ",
+[BC_LOG]    "log   ",
+[BC_INODE]  "inode ",
+[BC_BITMAP] "bitmap",
+[BC_DATA]   "data  ",
+};
+
+struct bcachestat st;
+struct bheat heat[256];
+
+void
+print(void)
+{
+  struct bstat tot;
+  uint64 *t, *c;
+
+  if(bstat(BSTAT_READ, &st, 0) < 0){
+    fprintf(2, "bstat: read failed\n");
+    exit(1);
+  }
+  printf("buffers %d (hot %d, max %d, %d buckets)\n",
+         st.nbuf, st.nhot, st.maxbuf, st.nbucket);
+  printf("class  lookups hits misses evicts reads writes pins waits\n");
+  memset(&tot, 0, sizeof(tot));
+  for(int i = 0; i < NBCLASS; i++){
+    struct bstat *s = &st.class[i];
+    printf("%s %ld %ld %ld %ld %ld %ld %ld %ld\n", classname[i], s->lookups,
+           s->hits, s->misses, s->evictions, s->reads, s->writes, s->pins,
+           s->waits);
+    t = (uint64 *)&tot;
+    c = (uint64 *)s;
+    for(int j = 0; j < sizeof(tot) / sizeof(uint64); j++)
+      t[j] += c[j];
+  }
+  printf("total  %ld %ld %ld %ld %ld %ld %ld %ld\n", tot.lookups, tot.hits,
+         tot.misses, tot.evictions, tot.reads, tot.writes, tot.pins,
+         tot.waits);
+  if(tot.lookups > 0)
+    printf("hit rate %ld%%\n", tot.hits * 100 / tot.lookups);
+}
+
+void
+printhot(int n)
+{
+  if(n > sizeof(heat) / sizeof(heat[0]))
+    n = sizeof(heat) / sizeof(heat[0]);
+  if((n = bstat(BSTAT_HOT, heat, n)) < 0){
+    fprintf(2, "bstat: read failed\n");
+    exit(1);
+  }
+  printf("block  class  uses\n");
+  for(int i = 0; i < n; i++)
+    printf("%d %s %ld\n", heat[i].blockno, classname[heat[i].class], heat[i].uses);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid;
+
+  if(argc == 1){
+    print();
+    exit(0);
+  }
+  if(strcmp(argv[1], "-h") == 0){
+    printhot(argc > 2 ? atoi(argv[2]) : NHEAT);
+    exit(0);
+  }
+
+  if(strcmp(argv[1], "-d") == 0){
+    sync();
+    bstat(BSTAT_DROP, 0, 0);
+    exit(0);
+  }
+
+  bstat(BSTAT_RESET, 0, 0);
+  if(strcmp(argv[1], "-r") == 0)
+    exit(0);
+
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "bstat: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv+1);
+    fprintf(2, "bstat: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+  print();
+  exit(0);
+}
@@ -0,0 +1,118 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/diskstat.h"
+#include "user/user.h"
+
+// Print disk driver statistics.
+//   diskstat              print the counters
+//   diskstat -p us        poll for up to us microseconds (0: off)
+//   diskstat -r           reset the counters
+//   diskstat cmd args...  reset, run cmd, then print
+//   diskstat -t cmd args  the same, and list cmd's requests
+
+struct diskstat st;
+struct disktrace tr[16];
+
+// print one latency histogram.
+void
+printlat(char *name, uint64 *lat)
+{
+  int i;
+
+  for(i = 0; i < NLAT; i++)
+    if(lat[i])
+      printf("%s latency <%dus: %ld\n", name, 2 << i, lat[i]);
+}
+
+// print and consume the trace records.
+void
+dump(void)
+{
+  int i, n;
+
+  printf("when(us) sector blocks rw depth latency(us)\n");
+  while((n = diskstat(DISKSTAT_DUMP, tr, sizeof(tr)/sizeof(tr[0]))) > 0){
+    for(i = 0; i < n; i++)
+      printf("%ld %ld %d %s %d %d\n", tr[i].when, tr[i].sector,
+             tr[i].nblocks, tr[i].write ? "w" : "r", tr[i].depth,
+             tr[i].latency);
+  }
+}
+
+void
+print(void)
+{
+  if(diskstat(DISKSTAT_READ, &st, 0) < 0){
+    fprintf(2, "diskstat: read failed\n");
+    exit(1);
+  }
+  printf("requests %ld notifies %ld interrupts %ld\n",
+         st.requests, st.notifies, st.interrupts);
+  printf("completions: interrupt %ld polled %ld\n", st.intr, st.polled);
+  printf("polling waits: hit %ld miss %ld (budget %dus)\n",
+         st.pollhit, st.pollmiss, st.pollus);
+  printf("scheduler: queued %ld merged %ld depth %d max %d",
+         st.queued, st.merged, st.depth, st.maxdepth);
+  if(st.queued > 0)
+    printf(" avg %ld.%ld", st.depthsum / st.queued,
+           st.depthsum * 10 / st.queued % 10);
+  printf("\n");
+  printf("features:%s%s (up to %d blocks a request)\n",
+         st.indirect ? " indirect" : "", st.eventidx ? " event-idx" : "",
+         st.maxseg);
+  printlat("read", st.lat[0]);
+  printlat("write", st.lat[1]);
+  if(st.tracelost)
+    printf("trace records lost %d\n", st.tracelost);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid, trace = 0;
+
+  if(argc == 1){
+    print();
+    exit(0);
+  }
+  if(strcmp(argv[1], "-p") == 0){
+    if(argc != 3 || diskstat(DISKSTAT_POLL, 0, atoi(argv[2])) < 0){
+      fprintf(2, "usage: diskstat -p microseconds\n");
+      exit(1);
+    }
+    exit(0);
+  }
+
+  if(strcmp(argv[1], "-t") == 0){
+    if(argc < 3){
+      fprintf(2, "usage: diskstat -t cmd args...\n");
+      exit(1);
+    }
+    trace = 1;
+    argv++;
+  }
+
+  diskstat(DISKSTAT_RESET, 0, 0);
+  if(strcmp(argv[1], "-r") == 0)
+    exit(0);
+  if(trace)
+    diskstat(DISKSTAT_TRACE, 0, 1);
+
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "diskstat: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv+1);
+    fprintf(2, "diskstat: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+  if(trace){
+    diskstat(DISKSTAT_TRACE, 0, 0);
+    dump();
+  }
+  print();
+  exit(0);
+}
@@ -0,0 +1,68 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+// Print kernel spinlock contention statistics.
+//   lockstat              print the table
+//   lockstat -r           reset all counters
+//   lockstat cmd args...  reset, run cmd, then print
+
+#define NSTAT 32
+
+struct lockstat st[NSTAT];
+
+void
+print(void)
+{
+  int n;
+
+  if((n = lockstat(LOCKSTAT_READ, st, NSTAT)) < 0){
+    fprintf(2, "lockstat: read failed\n");
+    exit(1);
+  }
+  printf("%s %s %s %s %s %s %s\n", "name            ", "locks",
+         "acquires", "contended", "spins", "wait(us)", "hold(us)");
+  for(int i = 0; i < n; i++){
+    char name[17];
+    int j;
+    // pad to a column.
+    for(j = 0; j < 16 && st[i].name[j]; j++)
+      name[j] = st[i].name[j];
+    for(; j < 16; j++)
+      name[j] = ' ';
+    name[16] = 0;
+    printf("%s %d %ld %ld %ld %ld %ld\n", name, st[i].nlocks,
+           st[i].nacquire, st[i].ncontend, st[i].nspin,
+           st[i].waittime, st[i].holdtime);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid;
+
+  if(argc == 1){
+    print();
+    exit(0);
+  }
+
+  lockstat(LOCKSTAT_RESET, 0, 0);
+  if(strcmp(argv[1], "-r") == 0)
+    exit(0);
+
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "lockstat: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv+1);
+    fprintf(2, "lockstat: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+  print();
+  exit(0);
+}
@@ -0,0 +1,41 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// Run a command restricted to a set of CPUs, e.g.
+//   taskset 1 usertests      (CPU 0 only)
+//   taskset 6 grind          (CPUs 1 and 2)
+// With -p, change the affinity of a running process instead.
+
+int
+main(int argc, char *argv[])
+{
+  int mask;
+
+  if(argc < 3){
+    fprintf(2, "usage: taskset mask command [args...]\n");
+    fprintf(2, "       taskset -p mask pid\n");
+    exit(1);
+  }
+
+  if(strcmp(argv[1], "-p") == 0){
+    if(argc != 4){
+      fprintf(2, "usage: taskset -p mask pid\n");
+      exit(1);
+    }
+    if(setaffinity(atoi(argv[3]), atoi(argv[2])) < 0){
+      fprintf(2, "taskset: cannot set affinity of %s\n", argv[3]);
+      exit(1);
+    }
+    exit(0);
+  }
+
+  mask = atoi(argv[1]);
+  if(setaffinity(0, mask) < 0){
+    fprintf(2, "taskset: bad cpu mask %s\n", argv[1]);
+    exit(1);
+  }
+  exec(argv[2], argv+2);
+  fprintf(2, "taskset: exec %s failed\n", argv[2]);
+  exit(1);
+}
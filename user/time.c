@@ -0,0 +1,54 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/rusage.h"
+#include "user/user.h"
+
+// Run a command and report the resources it used.
+
+static void
+prtime(char *what, uint64 us)
+{
+  printf("%s %ld.%ld%ld%ld\n", what, us / 1000000,
+         (us / 100000) % 10, (us / 10000) % 10, (us / 1000) % 10);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct rusage r0, r1;
+  int pid, t0, t1;
+
+  if(argc < 2){
+    fprintf(2, "usage: time command [args...]\n");
+    exit(1);
+  }
+
+  getrusage(RUSAGE_CHILDREN, &r0);
+  t0 = uptime();
+
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "time: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv+1);
+    fprintf(2, "time: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+
+  t1 = uptime();
+  getrusage(RUSAGE_CHILDREN, &r1);
+
+  // a tick is about a tenth of a second.
+  prtime("real", (uint64)(t1 - t0) * 100000);
+  prtime("user", r1.utime - r0.utime);
+  prtime("sys ", r1.stime - r0.stime);
+  printf("switches %ld voluntary %ld involuntary\n",
+         r1.nvcsw - r0.nvcsw, r1.nivcsw - r0.nivcsw);
+  printf("page faults %ld\n", r1.pgfaults - r0.pgfaults);
+  printf("blocks %ld in %ld out\n",
+         r1.inblock - r0.inblock, r1.oublock - r0.oublock);
+  exit(0);
+}
@@ -1,6 +1,8 @@
 #define SBRK_ERROR ((char *)-1)
 
 struct stat;
+struct rusage;
+struct lockstat;
 
 // system calls
 int fork(void);
@@ -24,6 +26,20 @@ int getpid(void);
 char* sys_sbrk(int,int);
 int pause(int);
 int uptime(void);
+int futex_wait(int*, int);
+int futex_wake(int*, int);
+int shmget(int, int);
+void* shmat(int);
+int shmdt(void*);
+int setaffinity(int, int);
+int getaffinity(int);
+int getrusage(int, struct rusage*);
+int waitpid(int, int*, int);
+int lockstat(int, struct lockstat*, int);
+int bstat(int, void*, int);
+int diskstat(int, void*, int);
+int sync(void);
+int shmrm(int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -7,6 +7,11 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/rusage.h"
+#include "kernel/wait.h"
+#include "kernel/bstat.h"
+#include "kernel/diskstat.h"
+#include "kernel/lockstat.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -2698,6 +2703,1248 @@ lazy_copy(char *s)
   exit(0);
 }
 
+// futex_wait() must return at once if the word no longer holds
+// the expected value, and must reject bad addresses.
+void
+futexbasic(char *s)
+{
+  int word = 1;
+
+  if(futex_wait(&word, 0) != -1){
+    printf("%s: futex_wait on changed word did not return -1\n", s);
+    exit(1);
+  }
+  if(futex_wake(&word, 1) != 0){
+    printf("%s: futex_wake with no waiters woke someone\n", s);
+    exit(1);
+  }
+  if(futex_wait((int*)((char*)&word + 1), 1) != -1){
+    printf("%s: futex_wait on misaligned word succeeded\n", s);
+    exit(1);
+  }
+  if(futex_wait((int*)0x3fffffc000, 0) != -1 ||
+     futex_wake((int*)0x3fffffc000, 1) != -1){
+    printf("%s: futex on unmapped address succeeded\n", s);
+    exit(1);
+  }
+
+  exit(0);
+}
+
+// a process blocked in futex_wait() is woken by futex_wake(),
+// and another is woken, and exits, when killed.
+void
+futexblock(char *s)
+{
+  int id, pid1, pid2, xstatus;
+  volatile int *w;
+
+  if((id = shmget(0, PGSIZE)) < 0 || (w = shmat(id)) == (int*)-1){
+    printf("%s: shmget/shmat failed\n", s);
+    exit(1);
+  }
+  shmrm(id);
+  w[0] = w[1] = w[2] = w[3] = 0;
+
+  pid1 = fork();
+  if(pid1 == 0){
+    w[1] = 1;
+    if(futex_wait((int*)&w[0], 0) != 0 || w[0] != 1)
+      exit(1);
+    exit(0);
+  }
+  pid2 = fork();
+  if(pid2 == 0){
+    w[3] = 1;
+    futex_wait((int*)&w[2], 0);
+    exit(0);  // nothing wakes it but kill().
+  }
+  if(pid1 < 0 || pid2 < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+
+  // give them time to block.
+  while(w[1] == 0 || w[3] == 0)
+    ;
+  pause(5);
+
+  w[0] = 1;
+  if(futex_wake((int*)&w[0], 1) != 1){
+    printf("%s: futex_wake did not wake the waiter\n", s);
+    exit(1);
+  }
+  if(waitpid(pid1, &xstatus, 0) != pid1 || xstatus != 0){
+    printf("%s: woken waiter failed\n", s);
+    exit(1);
+  }
+
+  kill(pid2);
+  if(waitpid(pid2, &xstatus, 0) != pid2 || xstatus != -1){
+    printf("%s: killed waiter did not exit\n", s);
+    exit(1);
+  }
+
+  exit(0);
+}
+
+// a shared memory segment is shared with forked children,
+// and futex_wait()/futex_wake() rendezvous through it.
+void
+shmtest(char *s)
+{
+  int id, pid, xstatus;
+  volatile int *w;
+
+  if((id = shmget(0, PGSIZE)) < 0){
+    printf("%s: shmget failed\n", s);
+    exit(1);
+  }
+  w = shmat(id);
+  if(w == (int*)-1){
+    printf("%s: shmat failed\n", s);
+    exit(1);
+  }
+  if(shmat(id) != (void*)-1){
+    printf("%s: shmat of attached segment succeeded\n", s);
+    exit(1);
+  }
+  w[0] = 0;
+  w[1] = 0;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    w[1] = 1234;
+    w[0] = 1;
+    futex_wake((int*)&w[0], 1);
+    exit(0);
+  }
+  while(w[0] == 0)
+    futex_wait((int*)&w[0], 0);
+  wait(&xstatus);
+  if(xstatus != 0 || w[1] != 1234){
+    printf("%s: child's write not visible\n", s);
+    exit(1);
+  }
+  if(shmdt((void*)w) != 0 || shmdt((void*)w) != -1){
+    printf("%s: shmdt failed\n", s);
+    exit(1);
+  }
+  if(shmrm(id) != 0){
+    printf("%s: shmrm failed\n", s);
+    exit(1);
+  }
+
+  exit(0);
+}
+
+// a segment survives its creator until shmrm(), and shmrm()
+// frees it, at once if unattached, else at the last shmdt().
+void
+shmrmtest(char *s)
+{
+  int i, id, id2, pid, xstatus;
+  volatile int *w;
+
+  // never-attached segments must not use up the table.
+  for(i = 0; i < 2*NSHM; i++){
+    if((id = shmget(0, PGSIZE)) < 0){
+      printf("%s: shmget %d failed\n", s, i);
+      exit(1);
+    }
+    if(shmrm(id) != 0 || shmrm(id) != -1 || shmat(id) != (void*)-1){
+      printf("%s: shmrm of unattached segment failed\n", s);
+      exit(1);
+    }
+  }
+
+  // the creator exits without removing it.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if((id = shmget(4242, PGSIZE)) < 0 || (w = shmat(id)) == (int*)-1)
+      exit(1);
+    w[0] = 4242;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child shmget/shmat failed\n", s);
+    exit(1);
+  }
+  if((id = shmget(4242, PGSIZE)) < 0 || (w = shmat(id)) == (int*)-1){
+    printf("%s: segment lost with its creator\n", s);
+    exit(1);
+  }
+  if(w[0] != 4242){
+    printf("%s: segment contents lost\n", s);
+    exit(1);
+  }
+
+  // removed while attached: the key is free, the pages aren't.
+  if(shmrm(id) != 0){
+    printf("%s: shmrm failed\n", s);
+    exit(1);
+  }
+  if((id2 = shmget(4242, PGSIZE)) < 0 || id2 == id){
+    printf("%s: removed segment still has its key\n", s);
+    exit(1);
+  }
+  if(shmat(id) != (void*)-1){
+    printf("%s: attached a removed segment\n", s);
+    exit(1);
+  }
+  if(w[0] != 4242){
+    printf("%s: removed segment freed while attached\n", s);
+    exit(1);
+  }
+  if(shmdt((void*)w) != 0 || shmrm(id2) != 0){
+    printf("%s: shmdt/shmrm failed\n", s);
+    exit(1);
+  }
+
+  exit(0);
+}
+
+// affinity masks are settable, validated, and inherited by fork().
+void
+affinitytest(char *s)
+{
+  int pid, xstatus;
+
+  if(getaffinity(0) <= 0){
+    printf("%s: getaffinity(0) failed\n", s);
+    exit(1);
+  }
+  if(setaffinity(0, 0) != -1 || setaffinity(999999, 1) != -1){
+    printf("%s: bad setaffinity succeeded\n", s);
+    exit(1);
+  }
+  if(setaffinity(0, 1) != 0 || getaffinity(getpid()) != 1){
+    printf("%s: setaffinity(0, 1) failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(getaffinity(0) == 1 ? 0 : 1);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child did not inherit affinity\n", s);
+    exit(1);
+  }
+
+  exit(0);
+}
+
+// getrusage() reports a reaped child's page faults to its parent.
+void
+rusagetest(char *s)
+{
+  struct rusage r0, r1;
+  int pid, xstatus;
+
+  if(getrusage(RUSAGE_SELF, &r0) != 0 || getrusage(999999, &r0) != -1){
+    printf("%s: getrusage self/bad pid\n", s);
+    exit(1);
+  }
+  if(getrusage(RUSAGE_CHILDREN, &r0) != 0){
+    printf("%s: getrusage children failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    char *p = sbrklazy(4*PGSIZE);
+    for(int i = 0; i < 4; i++)
+      p[i*PGSIZE] = 1;
+    exit(0);
+  }
+  wait(&xstatus);
+  getrusage(RUSAGE_CHILDREN, &r1);
+  if(xstatus != 0 || r1.pgfaults - r0.pgfaults < 4){
+    printf("%s: child's page faults not counted\n", s);
+    exit(1);
+  }
+
+  exit(0);
+}
+
+// waitpid() reaps a specific child, and WNOHANG doesn't block.
+void
+waitpidtest(char *s)
+{
+  int fds[2], pid1, pid2, xstatus;
+  char c;
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid1 = fork();
+  if(pid1 == 0){
+    read(fds[0], &c, 1);
+    exit(1);
+  }
+  pid2 = fork();
+  if(pid2 == 0)
+    exit(2);
+  if(pid1 < 0 || pid2 < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+
+  if(waitpid(pid1, &xstatus, WNOHANG) != 0){
+    printf("%s: WNOHANG on running child did not return 0\n", s);
+    exit(1);
+  }
+  if(waitpid(pid2, &xstatus, 0) != pid2 || xstatus != 2){
+    printf("%s: waitpid of second child failed\n", s);
+    exit(1);
+  }
+  write(fds[1], "x", 1);
+  if(waitpid(pid1, &xstatus, 0) != pid1 || xstatus != 1){
+    printf("%s: waitpid of first child failed\n", s);
+    exit(1);
+  }
+  if(waitpid(pid1, 0, WNOHANG) != -1 || wait(0) != -1){
+    printf("%s: waitpid of reaped child succeeded\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  exit(0);
+}
+
+// processes on several CPUs hammering one pipe's lock all get
+// it, and lockstat() counts the acquires and the waiting.
+void
+ticketlocktest(char *s)
+{
+  enum { NW = 3, NBYTES = 2000 };
+  struct lockstat st0, st1;
+  int fds[2], i, j, n, pid, xstatus;
+  char buf[64];
+
+  // needs a second CPU.
+  if(setaffinity(0, 2) != 0)
+    exit(0);
+  setaffinity(0, 1);
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  // this pipe's own lock, not the sum of all pipes'.
+  if(lockstat(LOCKSTAT_FD, &st0, fds[0]) != 0){
+    printf("%s: lockstat of pipe failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NW; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      // one writer per CPU, as far as there are CPUs.
+      if(setaffinity(0, 2 << i) != 0)
+        setaffinity(0, 2);
+      close(fds[0]);
+      for(j = 0; j < NBYTES; j++)
+        if(write(fds[1], "t", 1) != 1)
+          exit(1);
+      exit(0);
+    }
+  }
+  close(fds[1]);
+  for(n = 0; (i = read(fds[0], buf, sizeof(buf))) > 0; n += i)
+    ;
+  // before the close, which frees the pipe and its counters.
+  if(lockstat(LOCKSTAT_FD, &st1, fds[0]) != 0){
+    printf("%s: lockstat of pipe failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  for(i = 0; i < NW; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: writer failed\n", s);
+      exit(1);
+    }
+  }
+  if(n != NW*NBYTES){
+    printf("%s: read %d bytes, wanted %d\n", s, n, NW*NBYTES);
+    exit(1);
+  }
+
+  if(st1.nacquire - st0.nacquire < NW*NBYTES){
+    printf("%s: %ld pipe lock acquires for %d writes\n", s,
+           st1.nacquire - st0.nacquire, NW*NBYTES);
+    exit(1);
+  }
+  if(st1.ncontend == st0.ncontend){
+    printf("%s: no contention counted\n", s);
+    exit(1);
+  }
+
+  exit(0);
+}
+
+// well over the old fixed limit of 64 processes can be alive
+// at once, with distinct pids, and waitpid() reaps each one.
+void
+manyprocs(char *s)
+{
+  enum { N = 100 };
+  static int pids[N];
+  int fds[2], i, j, xstatus;
+  char c;
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    pids[i] = fork();
+    if(pids[i] < 0){
+      printf("%s: fork %d failed\n", s, i);
+      exit(1);
+    }
+    if(pids[i] == 0){
+      // stay alive until the parent closes the pipe.
+      close(fds[1]);
+      read(fds[0], &c, 1);
+      exit(i);
+    }
+  }
+  for(i = 0; i < N; i++){
+    for(j = 0; j < i; j++){
+      if(pids[i] == pids[j]){
+        printf("%s: children %d and %d both have pid %d\n", s, j, i, pids[i]);
+        exit(1);
+      }
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  for(i = N-1; i >= 0; i--){
+    if(waitpid(pids[i], &xstatus, 0) != pids[i] || xstatus != i){
+      printf("%s: waitpid of child %d failed\n", s, i);
+      exit(1);
+    }
+  }
+  if(wait(0) != -1){
+    printf("%s: child left over\n", s);
+    exit(1);
+  }
+
+  exit(0);
+}
+
+// several processes read and stat a file and look up its path
+// concurrently while another rewrites it in place; the readers
+// share the inode lock and must never see a torn block.
+void
+sharedlocktest(char *s)
+{
+  char buf[BSIZE];
+  int fd, i, j, pid, xstatus;
+  struct stat st;
+
+  unlink("shlk");
+  if((fd = open("shlk", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'a', sizeof(buf));
+  for(i = 0; i < 4; i++)
+    write(fd, buf, sizeof(buf));
+  close(fd);
+
+  for(i = 0; i < 5; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0 && i == 0){
+      // writer: flip every block between all-a and all-b.
+      for(j = 0; j < 20; j++){
+        memset(buf, j % 2 ? 'a' : 'b', sizeof(buf));
+        fd = open("shlk", O_RDWR);
+        for(int k = 0; k < 4; k++)
+          write(fd, buf, sizeof(buf));
+        close(fd);
+      }
+      exit(0);
+    }
+    if(pid == 0){
+      for(j = 0; j < 20; j++){
+        if((fd = open("shlk", O_RDONLY)) < 0 || fstat(fd, &st) < 0 ||
+           st.size != 4*BSIZE){
+          printf("%s: open/fstat failed\n", s);
+          exit(1);
+        }
+        while(read(fd, buf, sizeof(buf)) == sizeof(buf)){
+          for(int k = 1; k < sizeof(buf); k++){
+            if(buf[k] != buf[0]){
+              printf("%s: torn read\n", s);
+              exit(1);
+            }
+          }
+        }
+        close(fd);
+      }
+      exit(0);
+    }
+  }
+  for(i = 0; i < 5; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+  unlink("shlk");
+}
+
+// uptime() is read without a lock; it must still never go
+// backwards, even with several processes reading at once.
+void
+uptimetest(char *s)
+{
+  int i, j, pid, t0, t, xstatus;
+
+  for(i = 0; i < 4; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      t0 = uptime();
+      for(j = 0; j < 20000; j++){
+        if((t = uptime()) < t0){
+          printf("%s: uptime went backwards\n", s);
+          exit(1);
+        }
+        t0 = t;
+      }
+      exit(0);
+    }
+  }
+  t0 = uptime();
+  pause(2);
+  if(uptime() - t0 < 2){
+    printf("%s: pause(2) returned early\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 4; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+}
+
+// several processes write and read back their own files at
+// once, exercising buffer cache lookups and recycling in
+// parallel.
+void
+bcacheparallel(char *s)
+{
+  char name[8], buf[BSIZE];
+  int i, j, fd, pid, xstatus;
+
+  for(i = 0; i < 4; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      name[0] = 'b';
+      name[1] = 'c';
+      name[2] = '0' + i;
+      name[3] = 0;
+      if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+        printf("%s: create %s failed\n", s, name);
+        exit(1);
+      }
+      for(j = 0; j < 20; j++){
+        memset(buf, 'a' + i + j, sizeof(buf));
+        if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+          printf("%s: write failed\n", s);
+          exit(1);
+        }
+      }
+      close(fd);
+      fd = open(name, O_RDONLY);
+      for(j = 0; j < 20; j++){
+        if(read(fd, buf, sizeof(buf)) != sizeof(buf) ||
+           buf[0] != 'a' + i + j || buf[BSIZE-1] != 'a' + i + j){
+          printf("%s: read back wrong data\n", s);
+          exit(1);
+        }
+      }
+      close(fd);
+      unlink(name);
+      exit(0);
+    }
+  }
+  for(i = 0; i < 4; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+}
+
+// read a file sequentially in chunks that straddle blocks,
+// so that reads find blocks whose read-ahead is still in
+// flight; the data must come back intact.
+void
+readaheadtest(char *s)
+{
+  static char buf[600];
+  int fd, i, n, tot;
+
+  unlink("rahead");
+  if((fd = open("rahead", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 100; i++){
+    memset(buf, i, BSIZE/2);
+    if(write(fd, buf, BSIZE/2) != BSIZE/2 || write(fd, buf, BSIZE/2) != BSIZE/2){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  // twice: the second pass finds everything cached.
+  for(int pass = 0; pass < 2; pass++){
+    fd = open("rahead", O_RDONLY);
+    tot = 0;
+    while((n = read(fd, buf, sizeof(buf))) > 0){
+      for(i = 0; i < n; i++){
+        if(buf[i] != (char)((tot + i) / BSIZE)){
+          printf("%s: wrong data at %d\n", s, tot + i);
+          exit(1);
+        }
+      }
+      tot += n;
+    }
+    close(fd);
+    if(tot != 100*BSIZE){
+      printf("%s: read %d bytes\n", s, tot);
+      exit(1);
+    }
+  }
+  unlink("rahead");
+}
+
+// re-reading a file should hit in the buffer cache, and
+// bstat() should say so.
+void
+bstattest(char *s)
+{
+  static struct bcachestat st;
+  static struct bheat h[4];
+  char buf[BSIZE];
+  int fd, pass;
+
+  fd = open("bstat", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'x', sizeof(buf));
+  write(fd, buf, sizeof(buf));
+  close(fd);
+
+  if(bstat(BSTAT_RESET, 0, 0) != 0){
+    printf("%s: bstat reset failed\n", s);
+    exit(1);
+  }
+  for(pass = 0; pass < 2; pass++){
+    fd = open("bstat", O_RDONLY);
+    read(fd, buf, sizeof(buf));
+    close(fd);
+  }
+  if(bstat(BSTAT_READ, &st, 0) != 0){
+    printf("%s: bstat read failed\n", s);
+    exit(1);
+  }
+  if(st.nbuf < 1 || st.class[BC_DATA].hits < 1 ||
+     st.class[BC_INODE].lookups < 1){
+    printf("%s: counters not updated\n", s);
+    exit(1);
+  }
+  if(st.nbucket < 31 || st.nbucket < st.maxbuf / (2*4)){
+    printf("%s: %d buckets for %d buffers\n", s, st.nbucket, st.maxbuf);
+    exit(1);
+  }
+  if(bstat(BSTAT_HOT, h, 4) < 1 || h[0].uses < 1){
+    printf("%s: no hot blocks\n", s);
+    exit(1);
+  }
+  unlink("bstat");
+}
+
+// file data read through the page cache must reflect later
+// writes and truncation.
+void
+pcachetest(char *s)
+{
+  static char buf[3*4096];
+  int fd, i, n;
+
+  if((fd = open("pcache", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'a', sizeof(buf));
+  if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // read it all, caching its pages.
+  fd = open("pcache", O_RDONLY);
+  if(read(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf("%s: read failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // overwrite across a page boundary.
+  fd = open("pcache", O_RDWR);
+  memset(buf, 'b', 5000);
+  write(fd, buf, 5000);
+  close(fd);
+
+  memset(buf, 0, sizeof(buf));
+  fd = open("pcache", O_RDONLY);
+  n = read(fd, buf, sizeof(buf));
+  close(fd);
+  if(n != sizeof(buf)){
+    printf("%s: reread failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < n; i++){
+    if(buf[i] != (i < 5000 ? 'b' : 'a')){
+      printf("%s: stale data at %d\n", s, i);
+      exit(1);
+    }
+  }
+
+  // truncate and write less.
+  fd = open("pcache", O_RDWR|O_TRUNC);
+  write(fd, "cc", 2);
+  close(fd);
+  fd = open("pcache", O_RDONLY);
+  n = read(fd, buf, sizeof(buf));
+  close(fd);
+  if(n != 2 || buf[0] != 'c' || buf[1] != 'c'){
+    printf("%s: wrong data after truncate\n", s);
+    exit(1);
+  }
+  unlink("pcache");
+}
+
+// how many blocks of file data the buffer cache holds.
+static int
+ndatabufs(void)
+{
+  static struct bheat h[128];
+  int i, n, nd = 0;
+
+  n = bstat(BSTAT_HOT, h, 128);
+  for(i = 0; i < n; i++)
+    if(h[i].class == BC_DATA)
+      nd++;
+  return nd;
+}
+
+// a file read through the page cache isn't cached in the
+// buffer cache as well.
+void
+pcacheonce(char *s)
+{
+  static char buf[4*4096];
+  int fd, before;
+
+  if((fd = open("pcacheonce", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'p', sizeof(buf));
+  if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  sync();
+  bstat(BSTAT_DROP, 0, 0);
+
+  before = ndatabufs();
+  fd = open("pcacheonce", O_RDONLY);
+  if(read(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf("%s: read failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  // the directory's block may be cached now, but not the
+  // file's sixteen.
+  if(ndatabufs() - before > 4){
+    printf("%s: %d file blocks cached twice\n", s, ndatabufs() - before);
+    exit(1);
+  }
+  unlink("pcacheonce");
+}
+
+// re-reading a file that is in the page cache reads nothing
+// from the disk, read-ahead included.
+void
+pcachereread(char *s)
+{
+  static char buf[8*4096];
+  static struct bcachestat st;
+  int fd, i, pass;
+
+  if((fd = open("pcachereread", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'r', sizeof(buf));
+  if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // the first pass caches the pages; the second must not go
+  // to the disk. small reads, so read-ahead kicks in.
+  for(pass = 0; pass < 2; pass++){
+    if(pass == 1)
+      bstat(BSTAT_RESET, 0, 0);
+    fd = open("pcachereread", O_RDONLY);
+    for(i = 0; i < sizeof(buf); i += 512)
+      if(read(fd, buf, 512) != 512){
+        printf("%s: read failed\n", s);
+        exit(1);
+      }
+    close(fd);
+  }
+  if(bstat(BSTAT_READ, &st, 0) != 0){
+    printf("%s: bstat failed\n", s);
+    exit(1);
+  }
+  if(st.class[BC_DATA].reads != 0){
+    printf("%s: %ld data blocks read from disk\n", s, st.class[BC_DATA].reads);
+    exit(1);
+  }
+  unlink("pcachereread");
+}
+
+// disk requests complete whether the waiter polls for them
+// or sleeps until the interrupt.
+void
+diskpolltest(char *s)
+{
+  static struct diskstat st;
+  char buf[BSIZE];
+  int fd, i, us;
+
+  if(diskstat(DISKSTAT_READ, &st, 0) < 0){
+    printf("%s: diskstat failed\n", s);
+    exit(1);
+  }
+  us = st.pollus;
+  for(i = 0; i < 2; i++){
+    // first without polling, then polling for a long time.
+    diskstat(DISKSTAT_POLL, 0, i ? 10000 : 0);
+    diskstat(DISKSTAT_RESET, 0, 0);
+    if((fd = open("dpoll", O_CREATE|O_RDWR)) < 0){
+      printf("%s: create failed\n", s);
+      exit(1);
+    }
+    memset(buf, 'a' + i, sizeof(buf));
+    write(fd, buf, sizeof(buf));
+    close(fd);
+    diskstat(DISKSTAT_READ, &st, 0);
+    if(st.requests == 0 || st.intr + st.polled == 0){
+      printf("%s: no completions counted\n", s);
+      exit(1);
+    }
+    if(i == 0 && st.pollhit + st.pollmiss != 0){
+      printf("%s: polled with polling off\n", s);
+      exit(1);
+    }
+    unlink("dpoll");
+  }
+  diskstat(DISKSTAT_POLL, 0, us);
+}
+
+// a file big enough to fill the larger ring with write-back,
+// then read back, must come through intact. with EVENT_IDX,
+// batches of writes must take fewer interrupts than requests,
+// and a request longer than a direct descriptor chain allows
+// needs indirect descriptors.
+void
+diskringtest(char *s)
+{
+  static struct diskstat st;
+  static struct disktrace tr[NTRACE];
+  static char buf[BSIZE];
+  enum { N = 40 };
+  int fd, i, j, n, us, maxnb = 0;
+
+  diskstat(DISKSTAT_READ, &st, 0);
+  us = st.pollus;
+  diskstat(DISKSTAT_POLL, 0, 0);
+  diskstat(DISKSTAT_RESET, 0, 0);
+  diskstat(DISKSTAT_TRACE, 0, 1);
+  if((fd = open("dring", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    memset(buf, 'a' + i % 26, sizeof(buf));
+    if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  sync();
+  diskstat(DISKSTAT_TRACE, 0, 0);
+  diskstat(DISKSTAT_READ, &st, 0);
+  diskstat(DISKSTAT_POLL, 0, us);
+  while((n = diskstat(DISKSTAT_DUMP, tr, NTRACE)) > 0){
+    for(i = 0; i < n; i++){
+      if(tr[i].nblocks > st.maxseg){
+        printf("%s: %d-block request, limit %d\n", s, tr[i].nblocks, st.maxseg);
+        exit(1);
+      }
+      if(tr[i].nblocks > maxnb)
+        maxnb = tr[i].nblocks;
+    }
+  }
+
+  if(!st.eventidx){
+    printf("%s: EVENT_IDX not negotiated\n", s);
+    exit(1);
+  }
+  if(st.requests == 0 || st.interrupts >= st.requests){
+    printf("%s: %ld interrupts for %ld requests\n", s, st.interrupts, st.requests);
+    exit(1);
+  }
+  if(maxnb > DIRECTSEG && !st.indirect){
+    printf("%s: %d-block request without indirect descriptors\n", s, maxnb);
+    exit(1);
+  }
+
+  if((fd = open("dring", O_RDONLY)) < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    if(read(fd, buf, sizeof(buf)) != sizeof(buf)){
+      printf("%s: read failed\n", s);
+      exit(1);
+    }
+    for(j = 0; j < BSIZE; j++){
+      if(buf[j] != 'a' + i % 26){
+        printf("%s: block %d corrupt\n", s, i);
+        exit(1);
+      }
+    }
+  }
+  close(fd);
+  unlink("dring");
+}
+
+// concurrent writers go through the I/O scheduler, which
+// should send some of their blocks together.
+void
+ioschedtest(char *s)
+{
+  static struct diskstat st;
+  static char buf[BSIZE];
+  enum { NCHILD = 4, N = 20 };
+  char name[8];
+  int fd, i, j, pid, xst;
+
+  diskstat(DISKSTAT_RESET, 0, 0);
+  for(i = 0; i < NCHILD; i++){
+    if((pid = fork()) < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      strcpy(name, "iosch0");
+      name[5] = '0' + i;
+      if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+        printf("%s: create failed\n", s);
+        exit(1);
+      }
+      memset(buf, 'a' + i, sizeof(buf));
+      for(j = 0; j < N; j++){
+        if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+          printf("%s: write failed\n", s);
+          exit(1);
+        }
+      }
+      close(fd);
+      unlink(name);
+      exit(0);
+    }
+  }
+  for(i = 0; i < NCHILD; i++){
+    wait(&xst);
+    if(xst != 0)
+      exit(xst);
+  }
+  // each commit writes the log header and the log blocks
+  // after it, which are consecutive, so something merges.
+  sync();
+  diskstat(DISKSTAT_READ, &st, 0);
+  if(st.queued < NCHILD * N || st.maxdepth < 1 ||
+     st.merged == 0 || st.merged >= st.queued){
+    printf("%s: queued %ld merged %ld maxdepth %d\n", s,
+           st.queued, st.merged, st.maxdepth);
+    exit(1);
+  }
+}
+
+// every finished disk request lands in a latency histogram
+// and, while tracing, in the trace ring.
+void
+disktracetest(char *s)
+{
+  static struct diskstat st;
+  static struct disktrace tr[NTRACE];
+  char buf[BSIZE];
+  int fd, i, n;
+  uint64 nlat = 0;
+
+  diskstat(DISKSTAT_RESET, 0, 0);
+  diskstat(DISKSTAT_TRACE, 0, 1);
+  if((fd = open("dtrace", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'x', sizeof(buf));
+  write(fd, buf, sizeof(buf));
+  close(fd);
+  unlink("dtrace");
+  diskstat(DISKSTAT_TRACE, 0, 0);
+  diskstat(DISKSTAT_READ, &st, 0);
+  n = diskstat(DISKSTAT_DUMP, tr, NTRACE);
+
+  for(i = 0; i < NLAT; i++)
+    nlat += st.lat[0][i] + st.lat[1][i];
+  if(nlat == 0){
+    printf("%s: no requests in the histograms\n", s);
+    exit(1);
+  }
+  if(n <= 0){
+    printf("%s: no trace records\n", s);
+    exit(1);
+  }
+  for(i = 0; i < n; i++){
+    if(tr[i].nblocks < 1 || tr[i].depth < 1){
+      printf("%s: bad trace record %d\n", s, i);
+      exit(1);
+    }
+  }
+  if(diskstat(DISKSTAT_DUMP, tr, NTRACE) != 0){
+    printf("%s: dump didn't consume the records\n", s);
+    exit(1);
+  }
+}
+
+// concurrent creates, writes and unlinks in one directory,
+// so that each transaction changes blocks that the previous
+// one, still committing, has too.
+void
+groupcommit(char *s)
+{
+  enum { NCHILD = 4, N = 20 };
+  char name[8], buf[64];
+  int fd, i, j, pid, xst;
+
+  for(i = 0; i < NCHILD; i++){
+    if((pid = fork()) < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      strcpy(name, "gc0");
+      name[2] = '0' + i;
+      for(j = 0; j < N; j++){
+        if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+          printf("%s: create failed\n", s);
+          exit(1);
+        }
+        memset(buf, 'a' + (i+j) % 26, sizeof(buf));
+        if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+          printf("%s: write failed\n", s);
+          exit(1);
+        }
+        close(fd);
+        if((fd = open(name, O_RDONLY)) < 0 ||
+           read(fd, buf, sizeof(buf)) != sizeof(buf) ||
+           buf[sizeof(buf)-1] != 'a' + (i+j) % 26){
+          printf("%s: read back failed\n", s);
+          exit(1);
+        }
+        close(fd);
+        if(unlink(name) < 0){
+          printf("%s: unlink failed\n", s);
+          exit(1);
+        }
+      }
+      exit(0);
+    }
+  }
+  for(i = 0; i < NCHILD; i++){
+    wait(&xst);
+    if(xst != 0)
+      exit(xst);
+  }
+}
+
+// committing a transaction overwrites log blocks without
+// reading them first, even once they have left the cache.
+void
+lognoread(char *s)
+{
+  static struct bcachestat st;
+  char buf[BSIZE];
+  int fd, i;
+
+  // get the log blocks out of the cache.
+  sync();
+  bstat(BSTAT_DROP, 0, 0);
+
+  bstat(BSTAT_RESET, 0, 0);
+  if((fd = open("lognoread", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'l', sizeof(buf));
+  for(i = 0; i < 10; i++)
+    write(fd, buf, sizeof(buf));
+  close(fd);
+  unlink("lognoread");
+  sync();
+  if(bstat(BSTAT_READ, &st, 0) != 0){
+    printf("%s: bstat failed\n", s);
+    exit(1);
+  }
+  if(st.class[BC_LOG].writes == 0){
+    printf("%s: no log block writes\n", s);
+    exit(1);
+  }
+  if(st.class[BC_LOG].reads != 0){
+    printf("%s: %ld log block reads\n", s, st.class[BC_LOG].reads);
+    exit(1);
+  }
+}
+
+// a reader of a directory block that a writer keeps changing
+// in one transaction after another, each committing while the
+// next is open, must never see an entry it has seen vanish.
+void
+commitreader(char *s)
+{
+  enum { N = 40 };
+  struct dirent de;
+  char name[16];
+  int fd, i, pid, n, last = 0, reaped = 0, xst;
+
+  if(mkdir("crdir") < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  if((pid = fork()) < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    strcpy(name, "crdir/f");
+    for(i = 0; i < N; i++){
+      name[7] = '0' + i / 10;
+      name[8] = '0' + i % 10;
+      name[9] = 0;
+      if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+        printf("%s: create failed\n", s);
+        exit(1);
+      }
+      write(fd, name, 10);
+      close(fd);
+    }
+    exit(0);
+  }
+
+  while(1){
+    if((fd = open("crdir", O_RDONLY)) < 0){
+      printf("%s: open dir failed\n", s);
+      exit(1);
+    }
+    n = 0;
+    while(read(fd, &de, sizeof(de)) == sizeof(de))
+      if(de.inum != 0 && de.name[0] == 'f')
+        n++;
+    close(fd);
+    if(n < last){
+      printf("%s: %d entries, had %d\n", s, n, last);
+      exit(1);
+    }
+    last = n;
+    if(last == N)
+      break;
+    if(reaped){
+      printf("%s: only %d entries\n", s, last);
+      exit(1);
+    }
+    if(waitpid(pid, &xst, WNOHANG) == pid){
+      if(xst != 0)
+        exit(xst);
+      reaped = 1;
+    }
+  }
+  if(!reaped)
+    waitpid(pid, &xst, 0);
+
+  sync();
+  for(i = 0; i < N; i++){
+    strcpy(name, "crdir/f");
+    name[7] = '0' + i / 10;
+    name[8] = '0' + i % 10;
+    name[9] = 0;
+    unlink(name);
+  }
+  unlink("crdir");
+}
+
 struct test {
   void (*f)(char *);
   char *s;
@@ -2765,6 +4012,30 @@ struct test {
   {lazy_alloc, "lazy_alloc"},
   {lazy_unmap, "lazy_unmap"},
   {lazy_copy, "lazy_copy"},
+  {futexbasic, "futexbasic"},
+  {futexblock, "futexblock"},
+  {shmtest, "shmtest"},
+  {shmrmtest, "shmrmtest"},
+  {affinitytest, "affinitytest"},
+  {rusagetest, "rusagetest"},
+  {waitpidtest, "waitpidtest"},
+  {manyprocs, "manyprocs"},
+  {ticketlocktest, "ticketlocktest"},
+  {sharedlocktest, "sharedlocktest"},
+  {uptimetest, "uptimetest"},
+  {bcacheparallel, "bcacheparallel"},
+  {readaheadtest, "readaheadtest"},
+  {bstattest, "bstattest"},
+  {pcachetest, "pcachetest"},
+  {pcacheonce, "pcacheonce"},
+  {pcachereread, "pcachereread"},
+  {diskpolltest, "diskpolltest"},
+  {diskringtest, "diskringtest"},
+  {ioschedtest, "ioschedtest"},
+  {disktracetest, "disktracetest"},
+  {groupcommit, "groupcommit"},
+  {commitreader, "commitreader"},
+  {lognoread, "lognoread"},
   { 0, 0},
 };
 
@@ -42,3 +42,17 @@ entry("getpid");
 entry("sbrk");
 entry("pause");
 entry("uptime");
+entry("futex_wait");
+entry("futex_wake");
+entry("shmget");
+entry("shmat");
+entry("shmdt");
+entry("setaffinity");
+entry("getaffinity");
+entry("getrusage");
+entry("waitpid");
+entry("lockstat");
+entry("bstat");
+entry("diskstat");
+entry("sync");
+entry("shmrm");